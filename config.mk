@@ -21,7 +21,7 @@ MANPREFIX = ${PREFIX}/share/man
 
 
 # Shared libraries
-LIBS = ${ASANFLAGS}
+LIBS = -pthread ${ASANFLAGS}
 
 
 # Optimization flags
@@ -30,7 +30,7 @@ OPTS = -O2
 
 # compiler and linker flags
 CPPFLAGS = -D_POSIX_SOURCE_200809L -D_POSIX_C_SOURCE -D_DEFAULT_SOURCE ${DBGDEFS}
-CFLAGS = -std=c99 -Wpedantic -Wall -Wextra ${OPTS} ${DBGFLAGS} ${ASANFLAGS} ${CPPFLAGS}
+CFLAGS = -std=c99 -pthread -Wpedantic -Wall -Wextra ${OPTS} ${DBGFLAGS} ${ASANFLAGS} ${CPPFLAGS}
 LDFLAGS = ${LIBS}
 
 
@@ -28,21 +28,14 @@
 
 ASHE_PUBLIC void ashe_cleanup(void)
 {
-	a_ubyte canfail;
-
-#ifdef ASHE_DBG
-	canfail = 0;
-#else
-	canfail = 1;
-#endif
-	ashe_freehistlist(&ashe.sh_history, NULL, canfail);
+	ashe_freehistlist(&ashe.sh_history);
 	a_jobcntl_harvest(&ashe.sh_jobcntl);
 	a_shell_free(&ashe);
 }
 
 ASHE_PUBLIC void ashe_cleanupfork(void)
 {
-	ashe_freehistnodes(&ashe.sh_history);
+	ashe_freehistents(&ashe.sh_history);
 	a_shell_free(&ashe);
 }
 
@@ -98,7 +91,6 @@ ASHE_PUBLIC a_noret ashe_internal_panic(const char *restrict errmsg, a_int32 apa
 	if (ashe.sh_flags.panic || (apanic & APANIC_ABORT))
 		abort();
 
-	ashe_disable_jobcntl_updates();
 	ashe_mask_signals(SIG_BLOCK);
 
 	ashe.sh_flags.panic = 1; /* prevent recursive panic calls */
@@ -33,7 +33,6 @@ int main(int argc, char **argv)
 	ASHE_UNUSED(argc);
 	ASHE_UNUSED(argv);
 	struct a_jobcntl *jobcntl;
-	const char *cmd;
 	a_arr_char *statusbuf;
 	a_int32 status;
 
@@ -52,9 +51,7 @@ int main(int argc, char **argv)
 	REPL
 	{
 		a_jobcntl_update_and_notify(jobcntl);
-		ashe_enable_jobcntl_updates();
 		a_term_read();
-		ashe_disable_jobcntl_updates();
 		a_shell_clear_ast(&ashe);
 		a_shell_clear_strings(&ashe);
 		ashe_expandvars(&A_IBF);
@@ -62,8 +59,8 @@ int main(int argc, char **argv)
 		if (a_arr_len(A_IBF) <= 1)
 			continue;
 
-		cmd = ashe_dupstrn(a_arr_ptr(A_IBF), a_arr_len(A_IBF) - 1);
-		ashe_newhisthead(&ashe.sh_history, cmd);
+		ashe_newhisthead(&ashe.sh_history, a_arr_ptr(A_IBF), a_arr_len(A_IBF) - 1);
+		ashe_histappend(&ashe.sh_history);
 
 		if ((status = ashe_parse(a_arr_ptr(A_IBF))) == 1) {
 			continue;
@@ -16,6 +16,8 @@
 
 #include <signal.h>
 #include <stdio.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
 
 #include "aasync.h"
 #include "acommon.h"
@@ -27,22 +29,15 @@
 #include "adbg.h"
 #endif
 
-/* Signals which we handle and block/unblock. */
+/* Signals which we handle (blocked, read from 'sigfd'). */
 static const a_int32 signals[] = {
 	SIGINT,
 	SIGCHLD,
 	SIGWINCH,
 };
 
-ASHE_PRIVATE void SIGINT_handler(int signum);
-ASHE_PRIVATE void SIGCHLD_handler(int signum);
-ASHE_PRIVATE void SIGWINCH_handler(int signum);
-
-static a_sighandler handlers[] = {
-	SIGINT_handler,
-	SIGCHLD_handler,
-	SIGWINCH_handler,
-};
+/* signalfd of 'signals', -1 if not initialized */
+static a_int32 sigfd = -1;
 
 /* Mask signal 'signum' by specifying 'how'.
  * 'how' can be SIG_BLOCK or SIG_UNBLOCK. */
@@ -57,55 +52,6 @@ ASHE_PUBLIC void ashe_mask_signal(int signum, int how)
 		ashe_panic_libcall(sigprocmask);
 }
 
-/* SIGWINCH signal handler */
-ASHE_PRIVATE void SIGWINCH_handler(int signum)
-{
-	ASHE_UNUSED(signum);
-	ashe_mask_signals(SIG_BLOCK);
-	ashe.sh_int = 1;
-	sigwinch_redraw();
-#ifdef ASHE_DBG_CURSOR
-	debug_cursor();
-#endif
-#ifdef ASHE_DBG_LINES
-	debug_lines();
-#endif
-	ashe_mask_signals(SIG_UNBLOCK);
-}
-
-/* SIGINT signal handler */
-ASHE_PRIVATE void SIGINT_handler(int signum)
-{
-	ASHE_UNUSED(signum);
-	ashe_mask_signals(SIG_BLOCK);
-	ashe.sh_int = 1;
-	ashe_redraw_prompt();
-	resethistcurrent();
-#ifdef ASHE_DBG_CURSOR
-	debug_cursor();
-#endif
-#ifdef ASHE_DBG_LINES
-	debug_lines();
-#endif
-	ashe_mask_signals(SIG_UNBLOCK);
-}
-
-/* SIGCHLD signal handler */
-ASHE_PRIVATE void SIGCHLD_handler(int signum)
-{
-	ASHE_UNUSED(signum);
-	ashe_mask_signals(SIG_BLOCK);
-	ashe.sh_int = 1;
-	a_jobcntl_update_and_notify(&ashe.sh_jobcntl);
-#ifdef ASHE_DBG_CURSOR
-	debug_cursor();
-#endif
-#ifdef ASHE_DBG_LINES
-	debug_lines();
-#endif
-	ashe_mask_signals(SIG_UNBLOCK);
-}
-
 /* Masks signals in 'signals' array. */
 ASHE_PUBLIC void ashe_mask_signals(a_int32 how)
 {
@@ -115,45 +61,80 @@ ASHE_PUBLIC void ashe_mask_signals(a_int32 how)
 		ashe_mask_signal(signals[i], how);
 }
 
-/* Enables asynchronous 'JobControl' updates. */
-ASHE_PUBLIC void ashe_enable_jobcntl_updates(void)
+/* Returns the signalfd 'signals' are delivered through. */
+ASHE_PUBLIC a_int32 ashe_signal_fd(void)
 {
-	struct sigaction old_action;
-
-	sigaction(SIGCHLD, NULL, &old_action);
-	old_action.sa_handler = SIGCHLD_handler;
-	sigaction(SIGCHLD, &old_action, NULL);
+	return sigfd;
 }
 
-/* disables asynchronous 'JobControl' updates. */
-ASHE_PUBLIC void ashe_disable_jobcntl_updates(void)
+/*
+ * Handle signals that arrived (read from the signalfd) as
+ * ordinary events, all of the pending signals are read first
+ * so bursts of them (resizes, children exiting) end up in
+ * a single redraw.
+ */
+ASHE_PUBLIC void ashe_handle_signals(void)
 {
-	struct sigaction old_action;
-
-	sigaction(SIGCHLD, NULL, &old_action);
-	old_action.sa_handler = SIG_DFL;
-	sigaction(SIGCHLD, &old_action, NULL);
+	struct signalfd_siginfo si[16];
+	a_ubyte winch, intr, chld;
+	a_ssize n, i;
+
+	winch = intr = chld = 0;
+	while ((n = read(sigfd, si, sizeof(si))) > 0) {
+		for (i = 0; i < n / (a_ssize)sizeof(si[0]); i++) {
+			switch (si[i].ssi_signo) {
+			case SIGWINCH:
+				winch = 1;
+				break;
+			case SIGINT:
+				intr = 1;
+				break;
+			case SIGCHLD:
+				chld = 1;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	if (winch)
+		sigwinch_redraw();
+	if (chld)
+		a_jobcntl_update_and_notify(&ashe.sh_jobcntl);
+	if (intr) {
+		ashe_redraw_prompt();
+		resethistcurrent();
+	}
+#ifdef ASHE_DBG_CURSOR
+	debug_cursor();
+#endif
+#ifdef ASHE_DBG_LINES
+	debug_lines();
+#endif
 }
 
 // clang-format off
-/* Initializes signal handlers. */
+/*
+ * Initializes signal handling, 'signals' stay blocked and
+ * get delivered through the signalfd (see 'ashe_handle_signals()'),
+ * blocked SIGCHLD stays pending even though its action is default.
+ */
 ASHE_PUBLIC void ashe_init_sighandlers(void)
 {
-	a_sighandler handler;
 	struct sigaction default_action;
+	sigset_t set;
 	a_uint32 i;
 
+	sigemptyset(&set);
+	for (i = 0; i < ASHE_ELEMENTS(signals); i++)
+		sigaddset(&set, signals[i]);
+	if (a_unlikely(sigprocmask(SIG_BLOCK, &set, NULL) < 0))
+		ashe_panic_libcall(sigprocmask);
+	if (a_unlikely((sigfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC)) < 0))
+		ashe_panic_libcall(signalfd);
+
 	sigemptyset(&default_action.sa_mask);
 	default_action.sa_flags = 0;
-
-	for (i = 0; i < ASHE_ELEMENTS(signals); i++) {
-		handler = handlers[i];
-		if (signals[i] == SIGCHLD)
-			handler = SIG_DFL;
-		default_action.sa_handler = handler;
-		ashe_sigaction(signals[i], &default_action, NULL);
-	}
-
 	default_action.sa_handler = SIG_IGN;
 	ashe_sigaction(SIGTTIN, &default_action, NULL);
 	ashe_sigaction(SIGTTOU, &default_action, NULL);
@@ -22,7 +22,7 @@
 void ashe_init_sighandlers(void);
 void ashe_mask_signal(int signum, int how);
 void ashe_mask_signals(a_int32 how);
-void ashe_disable_jobcntl_updates(void);
-void ashe_enable_jobcntl_updates(void);
+a_int32 ashe_signal_fd(void);
+void ashe_handle_signals(void);
 
 #endif
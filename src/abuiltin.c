@@ -475,6 +475,7 @@ ASHE_PRIVATE a_int32 ashe_bi_cd(a_arr_ccharp *argv)
 		print_help_opts("cd");
 		a_defer(-1);
 	}
+	ashe_invalidate_placeholders(ASHE_PLH_CWD);
 defer:
 	return status;
 }
@@ -685,6 +686,7 @@ ASHE_PRIVATE a_int32 ashe_bi_clear(a_arr_ccharp *argv)
 	switch (argc) {
 	case 1:
 		ashe_clear_screen_unsafe();
+		a_term_flush();
 		break;
 	case 2:
 		if (is_help_opt(a_arrp_ptr(argv)[1])) {
@@ -700,18 +702,26 @@ ASHE_PRIVATE a_int32 ashe_bi_clear(a_arr_ccharp *argv)
 	return status;
 }
 
+/* names of all builtin commands */
+static const char *builtin[] = {
+	"cd",	"pwd",	"clear", "builtin", "fg",   "bg",
+	"jobs", "exec", "exit",	 "penv",    "senv", "renv",
+};
+
 ASHE_PRIVATE void print_builtins(void)
 {
-	static const char *builtin[] = {
-		"cd",	"pwd",	"clear", "builtin", "fg",   "bg",
-		"jobs", "exec", "exit",	 "penv",    "senv", "renv",
-	};
 	a_memmax i;
 
 	for (i = 0; i < ASHE_ELEMENTS(builtin); i++)
 		ashe_printf(stdout, "%s\r\n", builtin[i]);
 }
 
+/* Returns the name of 'i'th builtin command or NULL if there is none. */
+ASHE_PUBLIC const char *ashe_builtin_name(a_uint32 i)
+{
+	return (i < ASHE_ELEMENTS(builtin) ? builtin[i] : NULL);
+}
+
 ASHE_PRIVATE a_int32 ashe_bi_builtin(a_arr_ccharp *argv)
 {
 	static const char *usage[] = {
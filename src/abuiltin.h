@@ -38,5 +38,6 @@ enum a_builtin_type {
 
 a_int32 ashe_runbin(struct a_simple_cmd *scmd, enum a_builtin_type bi);
 a_int32 ashe_isbin(const char *command);
+const char *ashe_builtin_name(a_uint32 i);
 
 #endif
@@ -0,0 +1,540 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "acompl.h"
+#include "aalloc.h"
+#include "abuiltin.h"
+#include "ashell.h"
+#include "autils.h"
+
+
+ASHE_PRIVATE int cmpname(const void *a, const void *b)
+{
+	return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+ASHE_PRIVATE void sort_names(a_arr_ccharp *names)
+{
+	qsort(a_arrp_ptr(names), a_arrp_len(names), sizeof(const char *), cmpname);
+}
+
+ASHE_PUBLIC void a_cmdindex_init(struct a_cmdindex *ci)
+{
+	const char *name;
+	a_uint32 i;
+
+	a_arr_char_init(&ci->ci_path);
+	a_arr_cmddir_init(&ci->ci_dirs);
+	a_arr_ccharp_init(&ci->ci_builtins);
+	a_arr_ccharp_init(&ci->ci_matches);
+	for (i = 0; (name = ashe_builtin_name(i)); i++)
+		a_arr_ccharp_push(&ci->ci_builtins, name);
+	sort_names(&ci->ci_builtins);
+}
+
+ASHE_PRIVATE void cmddir_free(void *ptr)
+{
+	struct a_cmddir *dir = ptr;
+
+	ashe_free(dir->cd_path);
+	a_arr_char_free(&dir->cd_pool, NULL);
+	a_arr_ccharp_free(&dir->cd_names, NULL);
+}
+
+ASHE_PUBLIC void a_cmdindex_free(struct a_cmdindex *ci)
+{
+	a_arr_char_free(&ci->ci_path, NULL);
+	a_arr_cmddir_free(&ci->ci_dirs, cmddir_free);
+	a_arr_ccharp_free(&ci->ci_builtins, NULL);
+	a_arr_ccharp_free(&ci->ci_matches, NULL);
+}
+
+/* Returns the directory 'path' ('len' bytes long) from 'dirs' or NULL. */
+ASHE_PRIVATE struct a_cmddir *find_dir(a_arr_cmddir *dirs, const char *path, a_uint32 len)
+{
+	struct a_cmddir *dir;
+	a_uint32 i;
+
+	for (i = 0; i < a_arrp_len(dirs); i++) {
+		dir = a_arr_cmddir_index(dirs, i);
+		if (dir->cd_path && strncmp(dir->cd_path, path, len) == 0 &&
+		    dir->cd_path[len] == '\0')
+			return dir;
+	}
+	return NULL;
+}
+
+/* Returns '$PATH' if the directories are not from it, otherwise NULL. */
+ASHE_PRIVATE const char *changed_path(const struct a_cmdindex *ci)
+{
+	const char *path;
+
+	if (!(path = getenv("PATH")))
+		path = "";
+	if (a_arr_len(ci->ci_path) > 0 && strcmp(a_arr_ptr(ci->ci_path), path) == 0)
+		return NULL;
+	return path;
+}
+
+/*
+ * Sync the directories with '$PATH', directories that
+ * stayed in it keep their names. Relative directories
+ * are skipped, their entries depend on the cwd.
+ */
+ASHE_PRIVATE void sync_path(struct a_cmdindex *ci)
+{
+	struct a_cmddir *dir, newdir;
+	a_arr_cmddir old;
+	const char *path, *end;
+	a_uint32 i, len;
+
+	if (!(path = changed_path(ci)))
+		return;
+
+	old = ci->ci_dirs;
+	a_arr_cmddir_init(&ci->ci_dirs);
+	a_arr_len(ci->ci_path) = 0;
+	a_arr_char_push_str(&ci->ci_path, path, strlen(path));
+	a_arr_char_push(&ci->ci_path, '\0');
+	for (; *path; path = (*end ? end + 1 : end)) {
+		if (!(end = strchr(path, ':')))
+			end = path + strlen(path);
+		len = end - path;
+		if (len == 0 || *path != '/' || find_dir(&ci->ci_dirs, path, len))
+			continue;
+		if ((dir = find_dir(&old, path, len))) {
+			newdir = *dir;
+			dir->cd_path = NULL; /* moved */
+		} else {
+			newdir.cd_path = ashe_dupstrn(path, len);
+			newdir.cd_mtime = (struct timespec){ 0 };
+			newdir.cd_scanned = 0;
+			a_arr_char_init(&newdir.cd_pool);
+			a_arr_ccharp_init(&newdir.cd_names);
+		}
+		a_arr_cmddir_push(&ci->ci_dirs, newdir);
+	}
+	for (i = 0; i < a_arr_len(old); i++) {
+		dir = a_arr_cmddir_index(&old, i);
+		if (dir->cd_path)
+			cmddir_free(dir);
+	}
+	a_arr_cmddir_free(&old, NULL);
+}
+
+/*
+ * Scan 'dir' again if its mtime changed since the last scan.
+ * Every entry that is not a directory is taken (like other
+ * shells do for their command hash), checking the permissions
+ * of each one would cost a syscall per entry.
+ */
+ASHE_PRIVATE void scan_dir(struct a_cmddir *dir)
+{
+	struct dirent *ent;
+	struct stat st;
+	const char *name;
+	a_uint32 i;
+	DIR *dp;
+
+	if (stat(dir->cd_path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+		dir->cd_scanned = 0;
+		a_arr_len(dir->cd_pool) = 0;
+		a_arr_len(dir->cd_names) = 0;
+		return;
+	}
+	if (dir->cd_scanned && st.st_mtim.tv_sec == dir->cd_mtime.tv_sec &&
+	    st.st_mtim.tv_nsec == dir->cd_mtime.tv_nsec)
+		return;
+
+	dir->cd_mtime = st.st_mtim;
+	dir->cd_scanned = 1;
+	a_arr_len(dir->cd_pool) = 0;
+	a_arr_len(dir->cd_names) = 0;
+	if (!(dp = opendir(dir->cd_path)))
+		return;
+	while ((ent = readdir(dp))) {
+		name = ent->d_name;
+		if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+			continue;
+		if (ent->d_type == DT_DIR)
+			continue;
+		if (ent->d_type == DT_UNKNOWN &&
+		    (fstatat(dirfd(dp), name, &st, 0) < 0 || S_ISDIR(st.st_mode)))
+			continue;
+		a_arr_char_push_str(&dir->cd_pool, name, strlen(name) + 1);
+	}
+	closedir(dp);
+	/* pool is not growing anymore, pointers into it are stable */
+	for (i = 0; i < a_arr_len(dir->cd_pool); i += strlen(name) + 1) {
+		name = a_arr_char_index(&dir->cd_pool, i);
+		a_arr_ccharp_push(&dir->cd_names, name);
+	}
+	sort_names(&dir->cd_names);
+}
+
+ASHE_PUBLIC void a_cmdindex_sync(struct a_cmdindex *ci)
+{
+	a_uint32 i;
+
+	sync_path(ci);
+	for (i = 0; i < a_arr_len(ci->ci_dirs); i++)
+		scan_dir(a_arr_cmddir_index(&ci->ci_dirs, i));
+}
+
+ASHE_PUBLIC void a_cmdindex_warm(struct a_cmdindex *ci)
+{
+	if (changed_path(ci))
+		a_cmdindex_sync(ci);
+}
+
+/*
+ * Index of the first of the sorted 'names' ('n' of them) whose first
+ * 'len' bytes do not compare below 'prefix' (or above it if 'upper').
+ */
+ASHE_PRIVATE a_uint32 name_bound(const char *const *names, a_uint32 n, const char *prefix,
+				 a_uint32 len, a_ubyte upper)
+{
+	a_uint32 lo, hi, mid;
+	a_int32 cmp;
+
+	lo = 0;
+	hi = n;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strncmp(names[mid], prefix, len);
+		if (cmp < 0 || (upper && cmp == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Append names from 'names' starting with 'prefix' to the matches. */
+ASHE_PRIVATE a_ubyte push_matches(struct a_cmdindex *ci, const a_arr_ccharp *names,
+				  const char *prefix, a_uint32 len)
+{
+	a_uint32 start, end;
+
+	start = name_bound(a_arrp_ptr(names), a_arrp_len(names), prefix, len, 0);
+	end = name_bound(a_arrp_ptr(names), a_arrp_len(names), prefix, len, 1);
+	if (start == end)
+		return 0;
+	a_arr_ccharp_insert_n(&ci->ci_matches, a_arr_len(ci->ci_matches),
+			      a_arr_ccharp_index(names, start), end - start);
+	return 1;
+}
+
+ASHE_PUBLIC a_uint32 a_cmdindex_find(struct a_cmdindex *ci, const char *prefix, a_uint32 len)
+{
+	const char **names;
+	a_uint32 i, n, sources;
+
+	a_cmdindex_sync(ci);
+	a_arr_len(ci->ci_matches) = 0;
+	sources = push_matches(ci, &ci->ci_builtins, prefix, len);
+	for (i = 0; i < a_arr_len(ci->ci_dirs); i++)
+		sources += push_matches(ci, &a_arr_cmddir_index(&ci->ci_dirs, i)->cd_names,
+					prefix, len);
+	if (sources <= 1) /* already sorted and unique */
+		return a_arr_len(ci->ci_matches);
+
+	names = a_arr_ptr(ci->ci_matches);
+	sort_names(&ci->ci_matches);
+	for (i = n = 0; i < a_arr_len(ci->ci_matches); i++)
+		if (n == 0 || strcmp(names[n - 1], names[i]) != 0)
+			names[n++] = names[i];
+	a_arr_len(ci->ci_matches) = n;
+	return n;
+}
+
+
+/* [======== PATH COMPLETION =========] */
+
+/* number of cached directory listings */
+#define LISTING_CACHE_SIZE 16
+
+/* size of the 'getdents64' batches */
+#define GETDENTS_BUFSIZE (64 * 1024)
+
+/* record returned by 'getdents64' */
+struct dirent64_rec {
+	a_uint64 d_ino;
+	a_int64 d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/*
+ * Sorted entries of a directory, keyed by (dev, ino, mtime).
+ * Listings are loaded by the helper thread, so they are
+ * allocated with libc (see 'ashe_spawn_helper()').
+ */
+struct listing {
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	char *pool; /* null terminated names */
+	const char **names; /* sorted names in 'pool' */
+	a_uint32 nnames;
+	a_ubyte used;
+};
+
+/* directory listing loading in the helper thread */
+struct loadjob {
+	pthread_t thread;
+	char *path;
+	struct listing res; /* key is set before the start */
+	a_ubyte ok; /* listing loaded */
+	a_ubyte running; /* started and not joined yet */
+};
+
+static struct listing listings[LISTING_CACHE_SIZE];
+static a_uint32 listingnext; /* listing to replace next */
+static struct loadjob loadjob;
+static a_int32 loadpipe[2] = { -1, -1 }; /* helper thread writes here when done */
+static a_arr_ccharp pathmatches;
+
+ASHE_PRIVATE a_ubyte listing_is(const struct listing *ls, const struct stat *st)
+{
+	return (ls->dev == st->st_dev && ls->ino == st->st_ino &&
+		ls->mtime.tv_sec == st->st_mtim.tv_sec && ls->mtime.tv_nsec == st->st_mtim.tv_nsec);
+}
+
+ASHE_PRIVATE void listing_free(struct listing *ls)
+{
+	free(ls->pool);
+	free(ls->names);
+	ls->pool = NULL;
+	ls->names = NULL;
+	ls->nnames = 0;
+	ls->used = 0;
+}
+
+/*
+ * Load the entries of the directory 'path' into 'ls' using
+ * large 'getdents64' batches, names of directories (also through
+ * symlinks) get '/' appended. Runs in the helper thread.
+ */
+ASHE_PRIVATE a_ubyte load_listing(const char *path, struct listing *ls)
+{
+	struct dirent64_rec *ent;
+	a_memmax len, size, cap, i;
+	const char *name;
+	struct stat st;
+	a_ssize n, off;
+	a_ubyte isdir;
+	a_int32 fd;
+	char *buf, *p;
+
+	ls->pool = NULL;
+	ls->names = NULL;
+	ls->nnames = 0;
+	if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+		return 0;
+	if (!(buf = malloc(GETDENTS_BUFSIZE)))
+		goto fail;
+	size = cap = 0;
+	while ((n = syscall(SYS_getdents64, fd, buf, GETDENTS_BUFSIZE)) > 0) {
+		for (off = 0; off < n; off += ent->d_reclen) {
+			ent = (struct dirent64_rec *)(buf + off);
+			name = ent->d_name;
+			if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+				continue;
+			isdir = (ent->d_type == DT_DIR);
+			if (ent->d_type == DT_LNK || ent->d_type == DT_UNKNOWN)
+				isdir = (fstatat(fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode));
+			len = strlen(name);
+			if (size + len + 2 > cap) {
+				cap = a_max(cap * 2, size + len + 2);
+				if (!(p = realloc(ls->pool, cap)))
+					goto fail;
+				ls->pool = p;
+			}
+			memcpy(ls->pool + size, name, len);
+			size += len;
+			if (isdir)
+				ls->pool[size++] = '/';
+			ls->pool[size++] = '\0';
+			ls->nnames++;
+		}
+	}
+	if (n < 0 || !(ls->names = malloc(sizeof(*ls->names) * (ls->nnames + 1))))
+		goto fail;
+	for (i = 0, p = ls->pool; i < ls->nnames; i++, p += strlen(p) + 1)
+		ls->names[i] = p;
+	qsort(ls->names, ls->nnames, sizeof(*ls->names), cmpname);
+	free(buf);
+	close(fd);
+	return 1;
+fail:
+	free(buf);
+	listing_free(ls);
+	close(fd);
+	return 0;
+}
+
+ASHE_PRIVATE void *load_run(void *arg)
+{
+	struct loadjob *job;
+	a_ubyte done;
+
+	job = arg;
+	job->ok = load_listing(job->path, &job->res);
+	done = 1;
+	while (write(loadpipe[1], &done, 1) < 0 && errno == EINTR);
+	return NULL;
+}
+
+/*
+ * Start loading the listing of the directory 'path' ('st' is
+ * its stat) in the helper thread.
+ */
+ASHE_PRIVATE a_ubyte load_start(const char *path, const struct stat *st)
+{
+	loadjob.path = ashe_dupstrn(path, strlen(path));
+	loadjob.res.dev = st->st_dev;
+	loadjob.res.ino = st->st_ino;
+	loadjob.res.mtime = st->st_mtim;
+	if (a_likely(ashe_spawn_helper(load_run, &loadjob, loadpipe, &loadjob.thread)))
+		loadjob.running = 1;
+	else
+		ashe_free(loadjob.path);
+	return loadjob.running;
+}
+
+/* Join the helper thread and cache the listing it loaded. */
+ASHE_PRIVATE void load_finish(void)
+{
+	struct listing *ls;
+	a_uint32 i;
+
+	pthread_join(loadjob.thread, NULL);
+	loadjob.running = 0;
+	ashe_free(loadjob.path);
+	if (!loadjob.ok)
+		return;
+	for (i = 0, ls = NULL; i < LISTING_CACHE_SIZE && !ls; i++)
+		if (listings[i].used && listings[i].dev == loadjob.res.dev &&
+		    listings[i].ino == loadjob.res.ino)
+			ls = &listings[i]; /* stale listing of the same directory */
+	if (!ls) {
+		ls = &listings[listingnext];
+		listingnext = (listingnext + 1) % LISTING_CACHE_SIZE;
+	}
+	listing_free(ls);
+	*ls = loadjob.res;
+	ls->used = 1;
+}
+
+/* Wait at most 'timeout' milliseconds for the listing to load. */
+ASHE_PRIVATE a_ubyte load_wait(a_int32 timeout)
+{
+	struct pollfd pfd;
+
+	pfd.fd = loadpipe[0];
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, timeout) < 0)
+		if (errno != EINTR)
+			return 0;
+	return ashe_pathcompl_collect();
+}
+
+ASHE_PUBLIC a_int32 ashe_pathcompl_fd(void)
+{
+	return (loadjob.running ? loadpipe[0] : -1);
+}
+
+ASHE_PUBLIC a_ubyte ashe_pathcompl_collect(void)
+{
+	a_ubyte done;
+
+	if (!loadjob.running || read(loadpipe[0], &done, 1) <= 0)
+		return 0;
+	load_finish();
+	return 1;
+}
+
+ASHE_PUBLIC a_int32 ashe_pathcompl_find(const char *dir, const char *prefix, a_uint32 len,
+					a_int32 timeout)
+{
+	struct listing *ls;
+	struct stat st;
+	a_uint32 i, start, end;
+	const char *name;
+
+	a_arr_len(pathmatches) = 0;
+	if (stat(dir, &st) < 0 || !S_ISDIR(st.st_mode))
+		return 0;
+	for (i = 0, ls = NULL; i < LISTING_CACHE_SIZE && !ls; i++)
+		if (listings[i].used && listing_is(&listings[i], &st))
+			ls = &listings[i];
+	if (!ls) {
+		if (loadjob.running && !listing_is(&loadjob.res, &st))
+			return -1; /* loading another one, retried once it loads */
+		if (!loadjob.running && !load_start(dir, &st))
+			return 0;
+		if (!load_wait(timeout))
+			return -1;
+		return (loadjob.ok ? ashe_pathcompl_find(dir, prefix, len, 0) : 0);
+	}
+	start = name_bound(ls->names, ls->nnames, prefix, len, 0);
+	end = name_bound(ls->names, ls->nnames, prefix, len, 1);
+	for (i = start; i < end; i++) {
+		name = ls->names[i];
+		if (name[0] != '.' || (len > 0 && prefix[0] == '.'))
+			a_arr_ccharp_push(&pathmatches, name);
+	}
+	return a_arr_len(pathmatches);
+}
+
+ASHE_PUBLIC const a_arr_ccharp *ashe_pathcompl_matches(void)
+{
+	return &pathmatches;
+}
+
+ASHE_PUBLIC void ashe_pathcompl_free(void)
+{
+	a_uint32 i;
+
+	if (loadjob.running && ashe_join_helper(loadjob.thread)) {
+		if (loadjob.ok)
+			listing_free(&loadjob.res);
+		ashe_free(loadjob.path);
+	}
+	loadjob.running = 0;
+	for (i = 0; i < LISTING_CACHE_SIZE; i++)
+		listing_free(&listings[i]);
+	a_arr_ccharp_free(&pathmatches, NULL);
+	a_arr_ccharp_init(&pathmatches);
+	if (loadpipe[0] >= 0) {
+		close(loadpipe[0]);
+		close(loadpipe[1]);
+		loadpipe[0] = loadpipe[1] = -1;
+	}
+}
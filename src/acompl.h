@@ -0,0 +1,97 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#ifndef ACOMPL_H
+#define ACOMPL_H
+
+#include <time.h>
+
+#include "acommon.h"
+#include "aparser.h"
+
+
+/* directory from '$PATH' and the names of its entries */
+struct a_cmddir {
+	char *cd_path;
+	struct timespec cd_mtime; /* mtime when it was scanned */
+	a_ubyte cd_scanned; /* set if 'cd_names' are from 'cd_mtime' */
+	a_arr_char cd_pool; /* each name is null terminated */
+	a_arr_ccharp cd_names; /* sorted names in 'cd_pool' */
+};
+
+ARRAY_NEW(a_arr_cmddir, struct a_cmddir)
+
+/*
+ * Index of command names (builtins and entries of '$PATH'
+ * directories) for prefix lookups.
+ * It is built once the first prompt is drawn (and again
+ * when '$PATH' changes), each directory keeps its names
+ * sorted, so lookups only scan and sort again the
+ * directories whose mtime changed.
+ */
+struct a_cmdindex {
+	a_arr_char ci_path; /* '$PATH' the directories are from */
+	a_arr_cmddir ci_dirs;
+	a_arr_ccharp ci_builtins; /* sorted builtin names */
+	a_arr_ccharp ci_matches; /* result of the last lookup */
+};
+
+
+void a_cmdindex_init(struct a_cmdindex *ci);
+void a_cmdindex_free(struct a_cmdindex *ci);
+
+/* Sync the index with '$PATH' and its directories. */
+void a_cmdindex_sync(struct a_cmdindex *ci);
+
+/*
+ * Sync the index if it was never synced or '$PATH' changed,
+ * without checking the directories (lookups do that).
+ */
+void a_cmdindex_warm(struct a_cmdindex *ci);
+
+/*
+ * Find the names starting with 'prefix' ('len' bytes long),
+ * returns how many of them there are, they are stored in
+ * 'ci_matches' sorted and without duplicates.
+ */
+a_uint32 a_cmdindex_find(struct a_cmdindex *ci, const char *prefix, a_uint32 len);
+
+/*
+ * Find the entries of directory 'dir' starting with 'prefix'
+ * ('len' bytes long), entries starting with '.' are skipped
+ * unless 'prefix' does. Returns how many of them there are
+ * (see 'ashe_pathcompl_matches()') or -1 if the listing of
+ * 'dir' did not load within 'timeout' milliseconds, it keeps
+ * loading (see 'ashe_pathcompl_fd()').
+ */
+a_int32 ashe_pathcompl_find(const char *dir, const char *prefix, a_uint32 len,
+			    a_int32 timeout);
+
+/* Matches of the last 'ashe_pathcompl_find()', sorted and
+ * names of directories end with '/'. */
+const a_arr_ccharp *ashe_pathcompl_matches(void);
+
+/* File descriptor that becomes readable once the directory
+ * listing loads, -1 if none is loading. */
+a_int32 ashe_pathcompl_fd(void);
+
+/* Collect the loaded directory listing, returns 1 if it loaded. */
+a_ubyte ashe_pathcompl_collect(void);
+
+/* Free cached directory listings (joins the loader thread). */
+void ashe_pathcompl_free(void);
+
+#endif
@@ -86,11 +86,40 @@
  * In case any of the placeholders return NULL then
  * the placeholder won't get expanded and it will
  * remain unchanged.
+ *
+ * Each placeholder also says for how long its value
+ * stays valid, values are cached and the functions
+ * only get called again once the value expires.
+ *
+ * Async placeholders are computed in helper threads (so
+ * their functions must be reentrant and not panic), values
+ * are memoized per working directory. Prompt is drawn with
+ * the memoized (or blank) value if the helper does not finish
+ * within 'ASHE_PLH_DEADLINE_MS', and redrawn once it does.
  */
 #define ASHE_PLH_SIGN 	'%'
 
+/* Time in milliseconds the prompt waits for async placeholders. */
+#define ASHE_PLH_DEADLINE_MS 	20
+
 typedef const char *(*a_promptfn)(void);
 
+/* how long the placeholder value stays cached */
+enum a_plhcache {
+	ASHE_PLH_NOCACHE = 0, /* computed on each expansion */
+	ASHE_PLH_ONCE, /* computed once */
+	ASHE_PLH_CWD, /* until the working directory changes */
+	ASHE_PLH_MINUTE, /* until the wall clock minute changes */
+	ASHE_PLH_TTL, /* for 'ttl' seconds */
+};
+
+struct a_placeholder {
+	a_promptfn fn;
+	enum a_plhcache cache;
+	unsigned int ttl; /* seconds ('ASHE_PLH_TTL') */
+	unsigned char async; /* computed in a helper thread */
+};
+
 #ifdef ASHE_USE_PLACEHOLDERS_ARRAY /* include guard */
 extern const char *ashe_host(void);
 extern const char *ashe_user(void);
@@ -100,15 +129,21 @@ extern const char *ashe_adir(void);
 extern const char *ashe_time(void);
 extern const char *ashe_date(void);
 extern const char *ashe_uptime(void);
-static a_promptfn placeholders[] = {
-	ashe_host, /* 0: hostname */
-	ashe_user, /* 1: username */
-	ashe_jobc, /* 2: background jobs count */
-	ashe_dir, /* 3: current directory (trimmed) */
-	ashe_adir, /* 4: current directory (absolute path) */
-	ashe_time, /* 5: current time (HH:MM) */
-	ashe_date, /* 6: current date (YYYY-MM-DD) */
-	ashe_uptime, /* 7: system uptime (HHh MMm) */
+extern const char *ashe_vcs(void);
+extern const char *ashe_kube(void);
+extern const char *ashe_loadavg(void);
+static struct a_placeholder placeholders[] = {
+	{ ashe_host, ASHE_PLH_TTL, 60, 0 }, /* 0: hostname */
+	{ ashe_user, ASHE_PLH_ONCE, 0, 0 }, /* 1: username */
+	{ ashe_jobc, ASHE_PLH_NOCACHE, 0, 0 }, /* 2: background jobs count */
+	{ ashe_dir, ASHE_PLH_CWD, 0, 0 }, /* 3: current directory (trimmed) */
+	{ ashe_adir, ASHE_PLH_CWD, 0, 0 }, /* 4: current directory (absolute path) */
+	{ ashe_time, ASHE_PLH_MINUTE, 0, 0 }, /* 5: current time (HH:MM) */
+	{ ashe_date, ASHE_PLH_MINUTE, 0, 0 }, /* 6: current date (YYYY-MM-DD) */
+	{ ashe_uptime, ASHE_PLH_MINUTE, 0, 0 }, /* 7: system uptime (HHh MMm) */
+	{ ashe_vcs, ASHE_PLH_NOCACHE, 0, 1 }, /* 8: git branch (async) */
+	{ ashe_kube, ASHE_PLH_TTL, 30, 1 }, /* 9: kubernetes context (async) */
+	{ ashe_loadavg, ASHE_PLH_TTL, 5, 1 }, /* 10: load average, 1 minute (async) */
 };
 #endif
 
@@ -124,13 +159,41 @@ static a_promptfn placeholders[] = {
 /* ---- Prompt ---- */
 /*
  * Note:
- * tabs for now are not supported and will be unescaped,
+ * tabs are expanded up to the next tab stop (8 columns),
  * new line characters, carriage retrun, vertical tabs,
- * form feed are also prohibited and will be unescaped.
+ * form feed are prohibited and will be unescaped.
+ * Escape sequences (e.g. colors) take no columns.
  */
 #define ASHE_PROMPT 	"%1@%0 %3$ "
 
 
+/* ---- Input ---- */
+/*
+ * Time in milliseconds the shell waits for the rest of
+ * an escape sequence after reading the escape character.
+ * If nothing arrives in that time, escape key was pressed.
+ */
+#define ASHE_ESC_TIMEOUT_MS 	50
+
+/*
+ * Time in milliseconds the shell waits for more pasted
+ * text before it considers the bracketed paste finished,
+ * in case the terminal never sends the paste end sequence.
+ */
+#define ASHE_PASTE_TIMEOUT_MS 	500
+
+
+/* ---- Syntax highlighting ---- */
+/*
+ * SGR parameters (colors, bold...) of the highlighted
+ * parts of the input, as in 'ESC [ <parameters> m'.
+ */
+#define ASHE_HL_COMMAND 	"1"  /* command names (bold) */
+#define ASHE_HL_OPERATOR 	"36" /* redirections, pipes and separators (cyan) */
+#define ASHE_HL_STRING 		"33" /* inside of '"' (yellow) */
+#define ASHE_HL_ERROR 		"31" /* '"' that is not closed (red) */
+
+
 /* ---- Shell exit ---- */
 /*
  * Sleep time in-between shell sending a kill signal
@@ -149,9 +212,64 @@ static a_promptfn placeholders[] = {
 #define ASHE_HISTFILEPATH 	"$HOME/.ashe_hist"
 
 /*
- * Limit of how many commands history can hold.
+ * Limit of how many commands history can hold, once it is
+ * reached the oldest command expires for each new one.
+ * Commands are kept in a ring and their texts in a single
+ * buffer, so a limit in the millions is fine, memory use
+ * is dominated by the search indexes of the commands.
+ */
+#define ASHE_HISTLIMIT 		(1 << 16)
+
+/*
+ * If non-zero, command that is already in the history is moved
+ * to the front instead of being added again, so the history
+ * holds each command only once (newest occurrence of it).
+ * Off by default, when set the history file is deduplicated
+ * as it is loaded.
+ */
+#define ASHE_HISTERASEDUPS 	0
+
+/*
+ * Commands are appended to the history file as they are
+ * entered, once it holds more than this many of them it
+ * gets rewritten (in the background) without duplicates
+ * and with only the commands that are in the history.
+ */
+#define ASHE_HISTFILE_COMPACT 	(2 * ASHE_HISTLIMIT)
+
+
+/* ---- Completion ---- */
+/*
+ * Maximum number of completion candidates that
+ * get listed, the rest of them are only counted.
+ */
+#define ASHE_COMPL_MAXLIST 	256
+
+/*
+ * Time in milliseconds Tab waits for a directory listing
+ * to load, the rest of it loads in the background and the
+ * completion is done once it does.
+ */
+#define ASHE_COMPL_DEADLINE_MS 	20
+
+
+/* ---- Fuzzy finder ---- */
+/*
+ * Number of the best matches that get listed.
+ */
+#define ASHE_FUZZY_ROWS 	10
+
+/*
+ * Maximum number of threads scoring the candidates,
+ * there is at most one per online processor.
+ */
+#define ASHE_FUZZY_MAXTHREADS 	8
+
+/*
+ * Limit of how many paths under the current working
+ * directory are collected as candidates.
  */
-#define ASHE_HISTLIMIT 		1000
+#define ASHE_FUZZY_MAXPATHS 	(1 << 20)
 
 
 #endif
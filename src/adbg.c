@@ -562,7 +562,16 @@ ASHE_PUBLIC void debug_ast(struct a_block *block)
 ASHE_PUBLIC void debug_cursor(void)
 {
 	a_arr_char buffer;
+	a_uint32 realrow, realcol;
 	a_int32 fd;
+	a_ubyte ok;
+
+#ifdef ASHE_DBG_CURSOR
+	ok = a_term_check_cursor(&realrow, &realcol);
+#else
+	ok = 1;
+	realrow = realcol = 0;
+#endif
 
 	a_arr_char_init(&buffer);
 
@@ -570,8 +579,11 @@ ASHE_PUBLIC void debug_cursor(void)
 		ashe_panic_libwcall(ashe_open, "can't open logfile for cursor logging");
 	a_arr_char_push_strf(
 		&buffer,
-		"[TCOLMAX:%n][TROWMAX:%n][TCOL:%n][TROW:%n][ROW:%n][LINE_LEN:%n][COL:%n][IBFIDX:%n]\n",
-		A_TCOLMAX, A_TROWMAX, A_TCOL, A_TROW, A_IROW, A_ILINE.len, A_ICOL, A_IBFIDX);
+		"[TCOLMAX:%n][TROWMAX:%n][TCOL:%n][TROW:%n][ROW:%n][LINE_LEN:%n][COL:%n][IBFIDX:%n]"
+		"[SROW:%n][REALROW:%n][REALCOL:%n][FBYTES:%n][FWRITES:%n]%s\n",
+		A_TCOLMAX, A_TROWMAX, A_TCOL, A_TROW, A_IROW, A_ILINE.len, A_ICOL, A_IBFIDX,
+		A_ISROW, realrow, realcol, (a_ssize)A_TOS.os_lastbytes,
+		(a_ssize)A_TOS.os_lastwrites, (ok ? "" : " <- cursor model mismatch"));
 	ashe_write(fd, a_arr_ptr(buffer), a_arr_len(buffer));
 
 	ashe_close(fd);
@@ -583,7 +595,7 @@ ASHE_PUBLIC void debug_lines(void)
 {
 	a_arr_char buffer;
 	struct a_line *line;
-	a_uint32 i;
+	a_uint32 i, off;
 	a_int32 fd;
 
 	a_arr_char_init(&buffer);
@@ -593,13 +605,16 @@ ASHE_PUBLIC void debug_lines(void)
 
 	a_arr_char_push_strf(&buffer, "[A_TPLEN:%n] -> [", A_TPLEN);
 	a_arr_char_push_str(&buffer, a_arr_ptr(A_TP), A_TPLEN);
-	a_arr_char_push_strf(&buffer, "]\n[IBFLEN:%n] -> [", a_arr_len(A_IBF));
-	a_arr_char_push_str(&buffer, a_arr_ptr(A_IBF), a_arr_len(A_IBF));
+	a_arr_char_push_strf(&buffer, "]\n[IBFLEN:%n][GAP:%n] -> [", a_gapbuf_len(&A_IGB),
+			     A_IGB.gb_gap);
+	a_gapbuf_copy(&A_IGB, 0, a_gapbuf_len(&A_IGB), &buffer);
 	a_arr_char_push_strlit(&buffer, "]\n");
 	for (i = 0; i < A_ILINES.len; i++) {
 		line = a_arr_line_index(&A_ILINES, i);
-		a_arr_char_push_strf(&buffer, "[A_ILINE:%n][LEN:%n] -> [", i, line->len);
-		a_arr_char_push_str(&buffer, line->start, line->len);
+		off = a_input_lineoff(i);
+		a_arr_char_push_strf(&buffer, "[A_ILINE:%n][OFF:%n][LEN:%n][WIDTH:%n][ROWS:%n] -> [",
+				     i, off, line->len, line->width, line->rows);
+		a_gapbuf_copy(&A_IGB, off, off + line->len, &buffer);
 		a_arr_char_push_strlit(&buffer, "]\n");
 	}
 
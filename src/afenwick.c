@@ -0,0 +1,84 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#include "afenwick.h"
+#include "aalloc.h"
+#include "aarray.h"
+
+
+/* lowest set bit */
+#define lowbit(i) ((i) & -(i))
+
+
+ASHE_PUBLIC void a_fenwick_init(struct a_fenwick *fw)
+{
+	fw->fw_tree = NULL;
+	fw->fw_len = fw->fw_cap = 0;
+}
+
+ASHE_PUBLIC void a_fenwick_free(struct a_fenwick *fw)
+{
+	ashe_free(fw->fw_tree);
+	a_fenwick_init(fw);
+}
+
+ASHE_PUBLIC void a_fenwick_push(struct a_fenwick *fw, a_uint32 val)
+{
+	a_uint32 i, j, stop;
+
+	if (a_unlikely(fw->fw_len >= fw->fw_cap)) {
+		fw->fw_cap = GROW_ARRAY_CAPACITY(fw->fw_cap);
+		fw->fw_tree = ashe_realloc(fw->fw_tree, fw->fw_cap * sizeof(*fw->fw_tree));
+	}
+	i = ++fw->fw_len;
+	stop = i - lowbit(i);
+	for (j = i - 1; j > stop; j -= lowbit(j)) /* sum of '(stop, i)' */
+		val += fw->fw_tree[j - 1];
+	fw->fw_tree[i - 1] = val;
+}
+
+ASHE_PUBLIC void a_fenwick_add(struct a_fenwick *fw, a_uint32 idx, a_int32 delta)
+{
+	a_uint32 i;
+
+	ashe_assert(idx < fw->fw_len);
+	for (i = idx + 1; i <= fw->fw_len; i += lowbit(i))
+		fw->fw_tree[i - 1] += delta;
+}
+
+ASHE_PUBLIC a_uint32 a_fenwick_sum(const struct a_fenwick *fw, a_uint32 n)
+{
+	a_uint32 sum;
+
+	ashe_assert(n <= fw->fw_len);
+	for (sum = 0; n > 0; n -= lowbit(n))
+		sum += fw->fw_tree[n - 1];
+	return sum;
+}
+
+ASHE_PUBLIC a_uint32 a_fenwick_search(const struct a_fenwick *fw, a_uint32 target)
+{
+	a_uint32 pos, step;
+
+	for (step = 1; step <= fw->fw_len / 2; step <<= 1); /* highest power of 2 <= len */
+	for (pos = 0; step > 0; step >>= 1) {
+		if (pos + step <= fw->fw_len && fw->fw_tree[pos + step - 1] <= target) {
+			pos += step;
+			target -= fw->fw_tree[pos - 1];
+		}
+	}
+	return pos;
+}
@@ -0,0 +1,66 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#ifndef AFENWICK_H
+#define AFENWICK_H
+
+#include "acommon.h"
+
+
+/*
+ * Fenwick tree (binary indexed tree) over a sequence of
+ * unsigned values. Element update, prefix sum and prefix
+ * sum search are O(log n), appending is O(log n) amortized
+ * and truncating is O(1).
+ * Node 'i' (1-based) is 'fw_tree[i - 1]' and holds the sum
+ * of elements '(i - lowbit(i), i]'.
+ */
+struct a_fenwick {
+	a_uint32 *fw_tree;
+	a_uint32 fw_len; /* number of elements */
+	a_uint32 fw_cap; /* size of 'fw_tree' */
+};
+
+
+/* number of elements */
+#define a_fenwick_len(fw) ((fw)->fw_len)
+
+/* keep only the first 'n' elements (nodes below 'n' do not cover the rest) */
+#define a_fenwick_truncate(fw, n) ((fw)->fw_len = (n))
+
+/* sum of all elements */
+#define a_fenwick_total(fw) a_fenwick_sum(fw, (fw)->fw_len)
+
+
+void a_fenwick_init(struct a_fenwick *fw);
+void a_fenwick_free(struct a_fenwick *fw);
+
+/* Append element 'val'. */
+void a_fenwick_push(struct a_fenwick *fw, a_uint32 val);
+
+/* Add 'delta' to the element at index 'idx'. */
+void a_fenwick_add(struct a_fenwick *fw, a_uint32 idx, a_int32 delta);
+
+/* Sum of the first 'n' elements. */
+a_uint32 a_fenwick_sum(const struct a_fenwick *fw, a_uint32 n);
+
+/*
+ * Find the largest 'n' such that the sum of the first 'n'
+ * elements is not greater than 'target'.
+ */
+a_uint32 a_fenwick_search(const struct a_fenwick *fw, a_uint32 target);
+
+#endif
@@ -0,0 +1,532 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "afuzzy.h"
+#include "aalloc.h"
+#include "ashell.h"
+#include "autils.h"
+
+
+/* candidates in a block */
+#define BLOCK_SIZE 4096
+
+/* max number of blocks (history and paths) */
+#define MAXBLOCKS ((ASHE_HISTLIMIT + ASHE_FUZZY_MAXPATHS) / BLOCK_SIZE + 1)
+
+/* size of the pages holding the paths */
+#define PAGE_SIZE (64 * 1024)
+
+/* candidates a scoring thread takes at once, queries
+ * get abandoned in between the chunks */
+#define CHUNK_SIZE 1024
+
+/* longest query that is matched (rest is ignored) */
+#define QUERY_MAX 256
+
+/* scores */
+#define SCORE_MATCH	  16
+#define BONUS_BOUNDARY	  8 /* match at the start of a word or path component */
+#define BONUS_CONSECUTIVE 4 /* match right after the previous one */
+#define PENALTY_GAP_START 3 /* first skipped character in between the matches */
+#define PENALTY_GAP	  1 /* every other one */
+
+/* candidate */
+struct entry {
+	const char *s;
+	a_uint32 len;
+	a_uint64 mask; /* 'charbit()' of each byte */
+};
+
+/* page of path strings */
+struct page {
+	struct page *prev;
+	a_uint32 used;
+	char text[PAGE_SIZE];
+};
+
+/*
+ * Candidates and the shared state of the threads, everything
+ * that changes while the threads run is guarded by the 'lock'.
+ * Candidates are only appended, those below 'ncands' do not
+ * change anymore and get read without the lock. Memory here
+ * is allocated with libc (see 'ashe_spawn_helper()').
+ */
+static struct {
+	pthread_t threads[ASHE_FUZZY_MAXTHREADS];
+	pthread_t walker;
+	a_uint32 nthreads; /* scoring threads */
+	a_ubyte running;
+	pthread_mutex_t lock;
+	pthread_cond_t cond; /* candidates or query changed */
+	a_int32 pipe[2]; /* written to when the results change */
+	a_ubyte notified; /* pipe has unread byte */
+	a_ubyte stop;
+	/* candidates */
+	struct entry *blocks[MAXBLOCKS];
+	a_uint32 ncands; /* visible to the scoring threads */
+	a_uint32 nhist; /* history entries come first */
+	a_ubyte walked; /* all paths are collected */
+	struct page *pages;
+	/* query */
+	char query[QUERY_MAX];
+	a_uint32 qlen;
+	a_uint32 gen; /* changes with the query */
+	a_uint32 next; /* next candidate to score */
+	/* results */
+	struct a_fzmatch top[ASHE_FUZZY_ROWS];
+	a_uint32 ntop;
+	a_uint32 nmatched;
+	a_uint32 nscored;
+} fz = { .pipe = { -1, -1 } };
+
+#define entry_at(i) (&fz.blocks[(i) / BLOCK_SIZE][(i) % BLOCK_SIZE])
+
+
+/* [======== SCORING =========] */
+
+/*
+ * Bit of the byte 'c' in the 64-bit character mask of the
+ * candidates, letters ignore their case. Candidate can only
+ * match if its mask has every bit of the query mask, which
+ * rejects most of them with a single 'and' before any of
+ * their bytes are looked at.
+ */
+ASHE_PRIVATE inline a_uint64 charbit(a_ubyte c)
+{
+	if (c >= 'A' && c <= 'Z')
+		c |= 0x20;
+	if (c >= 'a' && c <= 'z')
+		return (a_uint64)1 << (c - 'a');
+	if (c >= '0' && c <= '9')
+		return (a_uint64)1 << (26 + c - '0');
+	return (a_uint64)1 << (36 + c % 28);
+}
+
+ASHE_PRIVATE a_uint64 charmask(const char *s, a_uint32 len)
+{
+	a_uint64 mask;
+	a_uint32 i;
+
+	for (i = 0, mask = 0; i < len; i++)
+		mask |= charbit(s[i]);
+	return mask;
+}
+
+/* 'c' matches the query byte 'q' */
+#define charmatch(c, q, exact) \
+	((c) == (q) || (!(exact) && (c) >= 'A' && (c) <= 'Z' && ((c) | 0x20) == (q)))
+
+/* 'i' starts a word or a path component of 's' */
+#define isboundary(s, i) \
+	((i) == 0 || ((s)[(i)-1] && strchr("/ _-.:=", (s)[(i)-1])) || \
+	 ((s)[(i)-1] >= 'a' && (s)[(i)-1] <= 'z' && (s)[i] >= 'A' && (s)[i] <= 'Z'))
+
+/*
+ * Score candidate 's' ('len' bytes long) against the query 'q'
+ * ('qlen' bytes long), returns 0 if it does not match.
+ * The first occurrence of the query is found going forward,
+ * then going backward from its end the shortest one ending
+ * there, which is scored: each matched byte scores, more if
+ * it starts a word or continues the previous match, bytes
+ * skipped in between the matches cost.
+ */
+ASHE_PRIVATE a_int32 score(const char *s, a_uint32 len, const char *q, a_uint32 qlen,
+			   a_ubyte exact)
+{
+	a_uint32 i, k, last;
+	a_int32 sc, bonus;
+
+	if (qlen == 0)
+		return 1;
+	for (i = k = 0; i < len; i++)
+		if (charmatch(s[i], q[k], exact) && ++k == qlen)
+			break;
+	if (k < qlen)
+		return 0;
+	for (; k > 0; i--)
+		if (charmatch(s[i], q[k - 1], exact) && --k == 0)
+			break;
+	for (sc = 0, last = i; k < qlen; i++) {
+		if (charmatch(s[i], q[k], exact)) {
+			bonus = (isboundary(s, i) ? BONUS_BOUNDARY : 0);
+			if (k > 0 && last == i - 1)
+				bonus = a_max(bonus, BONUS_CONSECUTIVE);
+			sc += SCORE_MATCH + bonus;
+			last = i;
+			k++;
+		} else {
+			sc -= (last == i - 1 ? PENALTY_GAP_START : PENALTY_GAP);
+		}
+	}
+	return a_max(sc, 1);
+}
+
+/* 'a' is better than 'b' */
+ASHE_PRIVATE inline a_ubyte better(const struct a_fzmatch *a, const struct a_fzmatch *b)
+{
+	if (a->score != b->score)
+		return a->score > b->score;
+	if (a->len != b->len)
+		return a->len < b->len;
+	return a->idx < b->idx;
+}
+
+/* Insert 'm' into the best matches 'top' ('*n' of them). */
+ASHE_PRIVATE void top_insert(struct a_fzmatch *top, a_uint32 *n, const struct a_fzmatch *m)
+{
+	a_uint32 i;
+
+	if (*n == ASHE_FUZZY_ROWS && !better(m, &top[*n - 1]))
+		return;
+	if (*n < ASHE_FUZZY_ROWS)
+		(*n)++;
+	for (i = *n - 1; i > 0 && better(m, &top[i - 1]); i--)
+		top[i] = top[i - 1];
+	top[i] = *m;
+}
+
+/* Wake up the main thread, called with the lock held. */
+ASHE_PRIVATE void notify(void)
+{
+	char c = 1;
+
+	if (!fz.notified) {
+		fz.notified = 1;
+		while (write(fz.pipe[1], &c, 1) < 0 && errno == EINTR);
+	}
+}
+
+/*
+ * Scoring thread, takes chunks of the candidates that were
+ * not scored yet, scores them against its own copy of the
+ * query and merges what matched into the results, unless the
+ * query changed in the meantime.
+ */
+ASHE_PRIVATE void *score_run(void *arg)
+{
+	struct a_fzmatch top[ASHE_FUZZY_ROWS], m;
+	char query[QUERY_MAX];
+	const struct entry *e;
+	a_uint32 i, gen, start, end, ntop, nmatched, qlen;
+	a_uint64 qmask;
+	a_ubyte exact;
+
+	(void)arg;
+	qlen = qmask = exact = 0;
+	pthread_mutex_lock(&fz.lock);
+	gen = fz.gen - 1;
+	for (;;) {
+		while (!fz.stop && fz.next >= fz.ncands)
+			pthread_cond_wait(&fz.cond, &fz.lock);
+		if (fz.stop)
+			break;
+		if (gen != fz.gen) {
+			gen = fz.gen;
+			qlen = fz.qlen;
+			memcpy(query, fz.query, qlen);
+			qmask = charmask(query, qlen);
+			for (i = exact = 0; i < qlen; i++)
+				exact |= (query[i] >= 'A' && query[i] <= 'Z');
+		}
+		start = fz.next;
+		end = a_min(start + CHUNK_SIZE, fz.ncands);
+		fz.next = end;
+		pthread_mutex_unlock(&fz.lock);
+
+		for (i = start, ntop = nmatched = 0; i < end; i++) {
+			e = entry_at(i);
+			if ((e->mask & qmask) != qmask)
+				continue;
+			if ((m.score = score(e->s, e->len, query, qlen, exact)) > 0) {
+				m.len = (qlen > 0 ? e->len : 0); /* empty query keeps the order */
+				m.idx = i;
+				top_insert(top, &ntop, &m);
+				nmatched++;
+			}
+		}
+
+		pthread_mutex_lock(&fz.lock);
+		if (gen == fz.gen) {
+			for (i = 0; i < ntop; i++)
+				top_insert(fz.top, &fz.ntop, &top[i]);
+			fz.nmatched += nmatched;
+			fz.nscored += end - start;
+			notify();
+		}
+	}
+	pthread_mutex_unlock(&fz.lock);
+	return NULL;
+}
+
+
+/* [======== CANDIDATES =========] */
+
+/* Append the candidate 's' ('len' bytes long), 0 if it is full or out of memory. */
+ASHE_PRIVATE a_ubyte add_entry(const char *s, a_uint32 len, a_uint32 n)
+{
+	struct entry *block;
+
+	if (n / BLOCK_SIZE >= MAXBLOCKS)
+		return 0;
+	if (!(block = fz.blocks[n / BLOCK_SIZE])) {
+		if (!(block = malloc(sizeof(*block) * BLOCK_SIZE)))
+			return 0;
+		fz.blocks[n / BLOCK_SIZE] = block;
+	}
+	block[n % BLOCK_SIZE] = (struct entry){ .s = s, .len = len, .mask = charmask(s, len) };
+	return 1;
+}
+
+/* Copy path 's' ('len' bytes long) into the pages. */
+ASHE_PRIVATE const char *add_path(const char *s, a_uint32 len)
+{
+	struct page *page;
+
+	page = fz.pages;
+	if (!page || page->used + len > PAGE_SIZE) {
+		if (!(page = malloc(sizeof(*page))))
+			return NULL;
+		page->prev = fz.pages;
+		page->used = 0;
+		fz.pages = page;
+	}
+	memcpy(page->text + page->used, s, len);
+	page->used += len;
+	return page->text + page->used - len;
+}
+
+/* Make candidates up to 'n' visible to the scoring threads. */
+ASHE_PRIVATE void publish(a_uint32 n)
+{
+	pthread_mutex_lock(&fz.lock);
+	fz.ncands = n;
+	pthread_cond_broadcast(&fz.cond);
+	notify();
+	pthread_mutex_unlock(&fz.lock);
+}
+
+/* Check if the fuzzy finder is stopping. */
+ASHE_PRIVATE a_ubyte stopping(void)
+{
+	a_ubyte stop;
+
+	pthread_mutex_lock(&fz.lock);
+	stop = fz.stop;
+	pthread_mutex_unlock(&fz.lock);
+	return stop;
+}
+
+/*
+ * Walker thread, collects the paths under the cwd breadth
+ * first (nearer ones come first), hidden entries are skipped
+ * and symlinks are not followed. Directories end with '/'.
+ */
+ASHE_PRIVATE void *walk_run(void *arg)
+{
+	char **dirs, **p, path[PATH_MAX + 1];
+	a_uint32 n, ndirs, cap, head, limit, len, dlen;
+	struct dirent *ent;
+	const char *s;
+	struct stat st;
+	a_ubyte isdir;
+	DIR *dp;
+
+	(void)arg;
+	n = fz.nhist;
+	limit = n + ASHE_FUZZY_MAXPATHS;
+	ndirs = 0;
+	cap = 64;
+	if ((dirs = malloc(sizeof(*dirs) * cap)) && (dirs[0] = calloc(1, 1)))
+		ndirs = 1; /* cwd */
+	for (head = 0; head < ndirs && n < limit && !stopping(); head++) {
+		dlen = strlen(dirs[head]);
+		memcpy(path, dirs[head], dlen + 1);
+		free(dirs[head]);
+		if (!(dp = opendir(dlen > 0 ? path : ".")))
+			continue;
+		while (n < limit && (ent = readdir(dp))) {
+			if (ent->d_name[0] == '.')
+				continue;
+			len = strlen(ent->d_name);
+			if (dlen + len + 1 > PATH_MAX)
+				continue;
+			isdir = (ent->d_type == DT_DIR);
+			if (ent->d_type == DT_UNKNOWN)
+				isdir = (fstatat(dirfd(dp), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+					 S_ISDIR(st.st_mode));
+			memcpy(path + dlen, ent->d_name, len);
+			path[dlen + len] = '/';
+			path[dlen + len + 1] = '\0';
+			if (!(s = add_path(path, dlen + len + isdir)) ||
+			    !add_entry(s, dlen + len + isdir, n))
+				goto oom;
+			if (++n % CHUNK_SIZE == 0)
+				publish(n);
+			if (!isdir)
+				continue;
+			if (ndirs == cap) {
+				if (!(p = realloc(dirs, sizeof(*dirs) * cap * 2)))
+					goto oom;
+				dirs = p;
+				cap *= 2;
+			}
+			if (!(dirs[ndirs] = malloc(dlen + len + 2)))
+				goto oom;
+			memcpy(dirs[ndirs++], path, dlen + len + 2);
+		}
+		closedir(dp);
+		continue;
+oom:
+		closedir(dp);
+		limit = n;
+	}
+	for (; head < ndirs; head++)
+		free(dirs[head]);
+	free(dirs);
+	pthread_mutex_lock(&fz.lock);
+	fz.walked = 1;
+	pthread_mutex_unlock(&fz.lock);
+	publish(n);
+	return NULL;
+}
+
+ASHE_PRIVATE void free_candidates(void)
+{
+	struct page *page;
+	a_uint32 i;
+
+	for (i = 0; i < MAXBLOCKS && fz.blocks[i]; i++) {
+		free(fz.blocks[i]);
+		fz.blocks[i] = NULL;
+	}
+	for (; (page = fz.pages); fz.pages = page->prev, free(page));
+}
+
+
+/* [======== INTERFACE =========] */
+
+ASHE_PUBLIC a_ubyte ashe_fuzzy_start(const struct a_histlist *hl)
+{
+	a_uint32 n, id;
+	a_int32 nproc;
+
+	if (fz.running)
+		return 1;
+	for (n = 0, id = hl->nextid; id-- != hl->firstid;) /* newest first */
+		if (ashe_histlen(hl, id) > 0 && !ashe_histent(hl, id)->erased &&
+		    add_entry(ashe_histtext(hl, id), ashe_histlen(hl, id), n))
+			n++;
+	fz.nhist = fz.ncands = n;
+	fz.walked = fz.stop = fz.notified = 0;
+	fz.qlen = fz.next = fz.ntop = fz.nmatched = fz.nscored = 0;
+	fz.gen++;
+
+	nproc = sysconf(_SC_NPROCESSORS_ONLN);
+	fz.nthreads = a_min((a_uint32)a_max(nproc, 1), ASHE_FUZZY_MAXTHREADS);
+	pthread_mutex_init(&fz.lock, NULL);
+	pthread_cond_init(&fz.cond, NULL);
+	if (a_likely(ashe_spawn_helper(walk_run, NULL, fz.pipe, &fz.walker))) {
+		fz.running = 1;
+		for (n = 0; n < fz.nthreads; n++)
+			if (a_unlikely(!ashe_spawn_helper(score_run, NULL, fz.pipe, &fz.threads[n])))
+				break;
+		fz.nthreads = n;
+	}
+	if (!fz.running) {
+		pthread_mutex_destroy(&fz.lock);
+		pthread_cond_destroy(&fz.cond);
+		free_candidates();
+	} else if (fz.nthreads == 0) {
+		ashe_fuzzy_stop();
+	}
+	return fz.running;
+}
+
+ASHE_PUBLIC void ashe_fuzzy_query(const char *query, a_uint32 len)
+{
+	if (!fz.running)
+		return;
+	len = a_min(len, QUERY_MAX);
+	pthread_mutex_lock(&fz.lock);
+	memcpy(fz.query, query, len);
+	fz.qlen = len;
+	fz.gen++;
+	fz.next = fz.ntop = fz.nmatched = fz.nscored = 0;
+	pthread_cond_broadcast(&fz.cond);
+	pthread_mutex_unlock(&fz.lock);
+}
+
+ASHE_PUBLIC a_int32 ashe_fuzzy_fd(void)
+{
+	return (fz.running ? fz.pipe[0] : -1);
+}
+
+ASHE_PUBLIC a_ubyte ashe_fuzzy_collect(struct a_fzresults *res)
+{
+	char c;
+
+	if (!fz.running || read(fz.pipe[0], &c, 1) <= 0)
+		return 0;
+	pthread_mutex_lock(&fz.lock);
+	fz.notified = 0;
+	memcpy(res->matches, fz.top, sizeof(*fz.top) * fz.ntop);
+	res->nmatches = fz.ntop;
+	res->nmatched = fz.nmatched;
+	res->ncands = fz.ncands;
+	res->done = (fz.walked && fz.nscored == fz.ncands);
+	pthread_mutex_unlock(&fz.lock);
+	return 1;
+}
+
+ASHE_PUBLIC const char *ashe_fuzzy_candidate(a_uint32 idx, a_uint32 *len, a_ubyte *ishist)
+{
+	const struct entry *e;
+
+	e = entry_at(idx);
+	*len = e->len;
+	*ishist = (idx < fz.nhist);
+	return e->s;
+}
+
+ASHE_PUBLIC void ashe_fuzzy_stop(void)
+{
+	a_uint32 i;
+	char c;
+
+	if (!fz.running || ashe.sh_flags.isfork) /* see 'ashe_join_helper()' */
+		return;
+	pthread_mutex_lock(&fz.lock);
+	fz.stop = 1;
+	pthread_cond_broadcast(&fz.cond);
+	pthread_mutex_unlock(&fz.lock);
+	pthread_join(fz.walker, NULL);
+	for (i = 0; i < fz.nthreads; i++)
+		pthread_join(fz.threads[i], NULL);
+	pthread_mutex_destroy(&fz.lock);
+	pthread_cond_destroy(&fz.cond);
+	fz.running = 0;
+	while (read(fz.pipe[0], &c, 1) > 0);
+	free_candidates();
+}
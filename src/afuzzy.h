@@ -0,0 +1,74 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#ifndef AFUZZY_H
+#define AFUZZY_H
+
+#include "acommon.h"
+#include "ahist.h"
+
+
+/* candidate that matched the query */
+struct a_fzmatch {
+	a_int32 score;
+	a_uint32 len; /* shorter candidates win ties */
+	a_uint32 idx; /* index of the candidate, older ones lose ties */
+};
+
+/* best matches of the current query so far */
+struct a_fzresults {
+	struct a_fzmatch matches[ASHE_FUZZY_ROWS]; /* best first */
+	a_uint32 nmatches; /* in 'matches' */
+	a_uint32 nmatched; /* candidates that matched so far */
+	a_uint32 ncands; /* candidates collected so far */
+	a_ubyte done; /* all of the candidates are collected and scored */
+};
+
+
+/*
+ * Start the fuzzy finder, candidates are the entries of
+ * history 'hl' (newest first, they must not change until
+ * it stops) followed by the paths under the cwd, which
+ * get collected in the background while scoring threads
+ * match them against the query (see 'ashe_fuzzy_query()').
+ * Returns 0 if the threads could not be started.
+ */
+a_ubyte ashe_fuzzy_start(const struct a_histlist *hl);
+
+/*
+ * Match the candidates against the 'query' ('len' bytes long),
+ * matching of the previous query is abandoned. Query is a
+ * subsequence of the candidates it matches, case is ignored
+ * unless the query has upper case letters in it.
+ */
+void ashe_fuzzy_query(const char *query, a_uint32 len);
+
+/* File descriptor that becomes readable once new results are
+ * available (see 'ashe_fuzzy_collect()'), -1 if not running. */
+a_int32 ashe_fuzzy_fd(void);
+
+/* Store the current results into 'res', returns 1 if they
+ * changed since the last time they were collected. */
+a_ubyte ashe_fuzzy_collect(struct a_fzresults *res);
+
+/* Candidate 'idx' ('len' bytes long), 'ishist' is set
+ * if it is a history entry, otherwise it is a path. */
+const char *ashe_fuzzy_candidate(a_uint32 idx, a_uint32 *len, a_ubyte *ishist);
+
+/* Stop the fuzzy finder (joins the threads), candidates are freed. */
+void ashe_fuzzy_stop(void);
+
+#endif
@@ -0,0 +1,125 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#include "agapbuf.h"
+#include "aalloc.h"
+
+
+/* Grow the gap so it can hold at least 'len' bytes. */
+ASHE_PRIVATE void growgap(struct a_gapbuf *gb, a_uint32 len)
+{
+	a_uint32 cap, taillen;
+
+	cap = GROW_ARRAY_CAPACITY(gb->gb_cap);
+	while (cap - a_gapbuf_len(gb) < len)
+		cap *= 2;
+	taillen = gb->gb_cap - gb->gb_gapend;
+	gb->gb_buf = ashe_realloc(gb->gb_buf, cap);
+	memmove(gb->gb_buf + cap - taillen, gb->gb_buf + gb->gb_gapend, taillen);
+	gb->gb_gapend = cap - taillen;
+	gb->gb_cap = cap;
+}
+
+ASHE_PUBLIC void a_gapbuf_init(struct a_gapbuf *gb, a_uint32 cap)
+{
+	gb->gb_buf = (cap > 0 ? ashe_malloc(cap) : NULL);
+	gb->gb_gap = 0;
+	gb->gb_gapend = gb->gb_cap = cap;
+}
+
+ASHE_PUBLIC void a_gapbuf_free(struct a_gapbuf *gb)
+{
+	ashe_free(gb->gb_buf);
+	a_gapbuf_init(gb, 0);
+}
+
+ASHE_PUBLIC void a_gapbuf_clear(struct a_gapbuf *gb)
+{
+	gb->gb_gap = 0;
+	gb->gb_gapend = gb->gb_cap;
+}
+
+ASHE_PUBLIC void a_gapbuf_moveto(struct a_gapbuf *gb, a_uint32 pos)
+{
+	a_uint32 gaplen;
+
+	ashe_assert(pos <= a_gapbuf_len(gb));
+	gaplen = a_gapbuf_gaplen(gb);
+	if (pos < gb->gb_gap) /* move text before the gap after it */
+		memmove(gb->gb_buf + pos + gaplen, gb->gb_buf + pos, gb->gb_gap - pos);
+	else if (pos > gb->gb_gap) /* move text after the gap before it */
+		memmove(gb->gb_buf + gb->gb_gap, gb->gb_buf + gb->gb_gapend, pos - gb->gb_gap);
+	gb->gb_gap = pos;
+	gb->gb_gapend = pos + gaplen;
+}
+
+ASHE_PUBLIC void a_gapbuf_insert(struct a_gapbuf *gb, a_uint32 pos, const char *s, a_uint32 len)
+{
+	if (a_unlikely(a_gapbuf_gaplen(gb) < len))
+		growgap(gb, len);
+	a_gapbuf_moveto(gb, pos);
+	memcpy(gb->gb_buf + gb->gb_gap, s, len);
+	gb->gb_gap += len;
+}
+
+ASHE_PUBLIC void a_gapbuf_remove(struct a_gapbuf *gb, a_uint32 pos, a_uint32 len)
+{
+	ashe_assert(pos + len <= a_gapbuf_len(gb));
+	a_gapbuf_moveto(gb, pos);
+	gb->gb_gapend += len;
+}
+
+ASHE_PUBLIC a_uint32 a_gapbuf_span(const struct a_gapbuf *gb, a_uint32 pos, const char **sp)
+{
+	if (pos < gb->gb_gap) {
+		*sp = gb->gb_buf + pos;
+		return gb->gb_gap - pos;
+	}
+	*sp = gb->gb_buf + pos + a_gapbuf_gaplen(gb);
+	return a_gapbuf_len(gb) - pos;
+}
+
+ASHE_PUBLIC a_uint32 a_gapbuf_chr(const struct a_gapbuf *gb, a_uint32 pos, char c)
+{
+	const char *s, *p;
+	a_uint32 len;
+
+	while ((len = a_gapbuf_span(gb, pos, &s)) > 0) {
+		if ((p = memchr(s, c, len)) != NULL)
+			return pos + (p - s);
+		pos += len;
+	}
+	return pos;
+}
+
+ASHE_PUBLIC const char *a_gapbuf_prefix(struct a_gapbuf *gb, a_uint32 pos)
+{
+	a_gapbuf_moveto(gb, pos);
+	return gb->gb_buf;
+}
+
+ASHE_PUBLIC void a_gapbuf_copy(const struct a_gapbuf *gb, a_uint32 from, a_uint32 to, a_arr_char *dst)
+{
+	const char *s;
+	a_uint32 len;
+
+	while (from < to && (len = a_gapbuf_span(gb, from, &s)) > 0) {
+		if (len > to - from)
+			len = to - from;
+		a_arr_char_push_str(dst, s, len);
+		from += len;
+	}
+}
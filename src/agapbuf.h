@@ -0,0 +1,87 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#ifndef AGAPBUF_H
+#define AGAPBUF_H
+
+#include "acommon.h"
+#include "atoken.h"
+
+
+/*
+ * Gap buffer, text is 'gb_buf[0, gb_gap)' followed by
+ * 'gb_buf[gb_gapend, gb_cap)'. Insertions and removals
+ * happen at the gap, so edits at the same position are
+ * O(1) amortized, gap is moved only when position changes.
+ * Positions are logical (the gap is not counted).
+ */
+struct a_gapbuf {
+	char *gb_buf;
+	a_uint32 gb_gap; /* gap start */
+	a_uint32 gb_gapend; /* gap end */
+	a_uint32 gb_cap; /* size of 'gb_buf' */
+};
+
+
+/* size of the gap */
+#define a_gapbuf_gaplen(gb) ((gb)->gb_gapend - (gb)->gb_gap)
+
+/* length of the text */
+#define a_gapbuf_len(gb) ((gb)->gb_cap - a_gapbuf_gaplen(gb))
+
+/* byte at position 'pos' */
+#define a_gapbuf_at(gb, pos) \
+	((gb)->gb_buf[(pos) < (gb)->gb_gap ? (pos) : (pos) + a_gapbuf_gaplen(gb)])
+
+
+void a_gapbuf_init(struct a_gapbuf *gb, a_uint32 cap);
+void a_gapbuf_free(struct a_gapbuf *gb);
+
+/* Remove all of the text. */
+void a_gapbuf_clear(struct a_gapbuf *gb);
+
+/* Move the gap to the position 'pos'. */
+void a_gapbuf_moveto(struct a_gapbuf *gb, a_uint32 pos);
+
+/* Insert 'len' bytes of 's' at the position 'pos'. */
+void a_gapbuf_insert(struct a_gapbuf *gb, a_uint32 pos, const char *s, a_uint32 len);
+
+/* Remove 'len' bytes starting at the position 'pos'. */
+void a_gapbuf_remove(struct a_gapbuf *gb, a_uint32 pos, a_uint32 len);
+
+/*
+ * Get the contiguous run of text starting at the position
+ * 'pos' (up to the gap or the end), pointer to it is stored
+ * in 'sp'. Returns the length of the run.
+ */
+a_uint32 a_gapbuf_span(const struct a_gapbuf *gb, a_uint32 pos, const char **sp);
+
+/*
+ * Find byte 'c' starting from the position 'pos',
+ * returns its position or text length if not found.
+ */
+a_uint32 a_gapbuf_chr(const struct a_gapbuf *gb, a_uint32 pos, char c);
+
+/*
+ * Get text in range [0, 'pos') as a contiguous string
+ * (not null terminated), this moves the gap to 'pos'.
+ */
+const char *a_gapbuf_prefix(struct a_gapbuf *gb, a_uint32 pos);
+
+/* Append the text in range ['from', 'to') to 'dst'. */
+void a_gapbuf_copy(const struct a_gapbuf *gb, a_uint32 from, a_uint32 to, a_arr_char *dst);
+
+#endif
@@ -0,0 +1,288 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "ahighlight.h"
+#include "ainput.h"
+#include "alex.h"
+#include "ashell.h"
+
+
+/* state at the start of the input */
+#define initstate() ((struct a_hlstate){ .cmd = 1 })
+
+/* no '"' opened in the line */
+#define NOQUOTE ((a_uint32)-1)
+
+
+ASHE_PRIVATE inline a_ubyte samestate(const struct a_hlstate *a, const struct a_hlstate *b)
+{
+	return (a->cmd == b->cmd && a->redir == b->redir && a->dq == b->dq && a->word == b->word &&
+		a->qback == b->qback && a->qoff == b->qoff);
+}
+
+/* Remove 'n' lines starting from the line 'from'. */
+ASHE_PRIVATE void remove_lines(struct a_highlight *hl, a_uint32 from, a_uint32 n)
+{
+	a_uint32 i;
+
+	for (i = from; i < from + n; i++)
+		a_arr_hlspan_free(&a_arr_hlline_index(&hl->hl_lines, i)->spans, NULL);
+	a_arr_hlline_remove_n(&hl->hl_lines, from, n);
+}
+
+/* Insert 'n' empty lines before the line 'at'. */
+ASHE_PRIVATE void insert_lines(struct a_highlight *hl, a_uint32 at, a_uint32 n)
+{
+	struct a_hlline line = { 0 };
+
+	a_arr_hlspan_init(&line.spans);
+	while (n--)
+		a_arr_hlline_insert(&hl->hl_lines, at, line);
+}
+
+ASHE_PUBLIC void a_highlight_init(struct a_highlight *hl)
+{
+	a_arr_hlline_init(&hl->hl_lines);
+	hl->hl_end = initstate();
+	hl->hl_from = 0;
+	hl->hl_to = A_HL_ALL;
+	hl->hl_delta = 0;
+	hl->hl_dirty = 1;
+	a_arr_char_init(&hl->hl_text);
+}
+
+ASHE_PUBLIC void a_highlight_free(struct a_highlight *hl)
+{
+	remove_lines(hl, 0, a_arr_len(hl->hl_lines));
+	a_arr_hlline_free(&hl->hl_lines, NULL);
+	a_arr_char_free(&hl->hl_text, NULL);
+}
+
+/* Edits between two updates make all of the lines after the first edit dirty. */
+ASHE_PUBLIC void a_highlight_edit(struct a_highlight *hl, a_uint32 from, a_uint32 to, a_int32 delta)
+{
+	if (hl->hl_dirty) {
+		if (from < hl->hl_from)
+			hl->hl_from = from;
+		hl->hl_to = A_HL_ALL;
+		return;
+	}
+	hl->hl_from = from;
+	hl->hl_to = to;
+	hl->hl_delta = delta;
+	hl->hl_dirty = 1;
+}
+
+ASHE_PRIVATE void push_span(a_arr_hlspan *spans, a_uint32 off, a_uint32 len, a_ubyte type)
+{
+	struct a_hlspan *last;
+
+	if (len == 0 || type == A_HL_NONE)
+		return;
+	if (a_arrp_len(spans) > 0) {
+		last = a_arr_hlspan_last(spans);
+		if (last->type == type && last->off + last->len == off) {
+			last->len += len;
+			return;
+		}
+	}
+	a_arr_hlspan_push(spans, (struct a_hlspan){ .off = off, .len = len, .type = type });
+}
+
+/*
+ * Push spans of the word ['s', 'e') of the line 'text', its quoted
+ * parts are strings, the rest is 'type'. Word starts inside of '"'
+ * if 'dq' is set. 'qo' is set to the offset of the '"' that is
+ * still open at the end of the word (quotes toggle the same way
+ * as in the lexer).
+ */
+ASHE_PRIVATE void word_spans(a_arr_hlspan *spans, const char *text, a_uint32 s, a_uint32 e,
+			     a_ubyte dq, a_ubyte type, a_uint32 *qo)
+{
+	a_uint32 p, start;
+	a_ubyte esc;
+
+	esc = 0;
+	for (p = start = s; p < e; p++) {
+		if (!esc && text[p] == '"') {
+			if (dq) {
+				push_span(spans, start, p + 1 - start, A_HL_STRING);
+				start = p + 1;
+				*qo = NOQUOTE;
+			} else {
+				push_span(spans, start, p - start, type);
+				start = p;
+				*qo = p;
+			}
+			dq ^= 1;
+		}
+		esc ^= (text[p] == '\\' || esc);
+	}
+	push_span(spans, start, e - start, (dq ? A_HL_STRING : type));
+}
+
+/*
+ * Lex the input line at the offset 'off' ('len' bytes long) into
+ * 'spans', starting from the 'state', which becomes the state at
+ * the start of the next line.
+ */
+ASHE_PRIVATE void lex_line(struct a_highlight *hl, struct a_hlstate *state, a_uint32 off,
+			   a_uint32 len, a_arr_hlspan *spans)
+{
+	struct a_lexer lexer;
+	struct a_token token;
+	const char *text;
+	a_uint32 qo;
+	a_ubyte word, cont;
+
+	a_arrp_len(spans) = 0;
+	a_arr_len(hl->hl_text) = 0;
+	a_gapbuf_copy(&A_IGB, off, off + len, &hl->hl_text);
+	a_arr_char_push(&hl->hl_text, '\0');
+	text = a_arr_ptr(hl->hl_text);
+
+	a_lexer_init(&lexer, text);
+	lexer.scan = 1;
+	lexer.dq = state->dq;
+	qo = NOQUOTE;
+	for (;;) {
+		cont = lexer.dq;
+		token = a_lexer_next(&lexer);
+		switch (token.type) {
+		case TK_EOL:
+			goto eol;
+		case TK_LESS:
+		case TK_GREATER:
+		case TK_GREATER_GREATER:
+		case TK_GREATER_PIPE:
+		case TK_LESS_AND:
+		case TK_GREATER_AND:
+		case TK_LESS_GREATER:
+		case TK_AND_GREATER:
+		case TK_AND_GREATER_GREATER:
+			push_span(spans, token.start - text, token.end - token.start, A_HL_OPERATOR);
+			state->redir = 1;
+			break;
+		case TK_SEMICOLON:
+		case TK_PIPE:
+		case TK_PIPE_PIPE:
+		case TK_AND:
+		case TK_AND_AND:
+		case TK_LPAREN:
+		case TK_RPAREN:
+			push_span(spans, token.start - text, token.end - token.start, A_HL_OPERATOR);
+			state->cmd = 1;
+			state->redir = 0;
+			break;
+		default: /* word */
+			if (cont) {
+				word = state->word;
+			} else if (state->redir) {
+				word = A_HL_NONE;
+				state->redir = 0;
+			} else if (state->cmd && token.type != TK_KVPAIR) {
+				word = A_HL_COMMAND;
+				state->cmd = 0;
+			} else {
+				word = A_HL_NONE;
+			}
+			word_spans(spans, text, token.start - text, token.end - text, cont, word, &qo);
+			state->word = word;
+			break;
+		}
+	}
+eol:
+	if (lexer.dq) {
+		if (qo != NOQUOTE) { /* opened in this line */
+			state->qback = 1;
+			state->qoff = qo;
+		} else {
+			state->qback++;
+		}
+	} else {
+		state->word = A_HL_NONE;
+		state->qback = state->qoff = 0;
+	}
+	state->dq = lexer.dq;
+}
+
+ASHE_PUBLIC void a_highlight_update(struct a_highlight *hl)
+{
+	struct a_hlstate state;
+	struct a_hlline *line;
+	a_uint32 i, n, off, old, from, to, nlines;
+
+	if (!hl->hl_dirty)
+		return;
+	hl->hl_dirty = 0;
+	nlines = a_arr_len(A_ILINES);
+	old = a_arr_len(hl->hl_lines);
+	from = hl->hl_from;
+	to = hl->hl_to;
+	if (from >= old) {
+		from = 0;
+		to = A_HL_ALL;
+	} else if (to != A_HL_ALL && (to < from || to >= nlines || old + hl->hl_delta != nlines ||
+				       (a_int32)(to - from + 1) <= hl->hl_delta)) {
+		to = A_HL_ALL;
+	}
+
+	state = (from < old ? a_arr_hlline_index(&hl->hl_lines, from)->start : initstate());
+	if (to == A_HL_ALL) {
+		remove_lines(hl, from, old - from);
+		insert_lines(hl, from, nlines - from);
+	} else { /* swap the changed lines, the rest of them only moved */
+		remove_lines(hl, from, to - from + 1 - hl->hl_delta);
+		insert_lines(hl, from, to - from + 1);
+	}
+
+	off = a_input_lineoff(from);
+	for (i = from; i < nlines; i++, off += n) {
+		line = a_arr_hlline_index(&hl->hl_lines, i);
+		if (to != A_HL_ALL && i > to && samestate(&line->start, &state))
+			return; /* converged, the rest is the same */
+		line->start = state;
+		n = a_arr_line_index(&A_ILINES, i)->len;
+		lex_line(hl, &state, off, n, &line->spans);
+	}
+	hl->hl_end = state;
+}
+
+/* Strings that are still open at the end of the input are errors. */
+ASHE_PUBLIC a_ubyte a_highlight_at(const struct a_highlight *hl, a_uint32 i, a_uint32 off, a_uint32 *hint)
+{
+	const a_arr_hlspan *spans;
+	const struct a_hlspan *span;
+	a_uint32 k, qline;
+
+	if (i >= a_arr_len(hl->hl_lines))
+		return A_HL_NONE;
+	spans = &a_arr_hlline_index(&hl->hl_lines, i)->spans;
+	for (k = *hint; k < a_arrp_len(spans); k++)
+		if (off < a_arr_hlspan_index(spans, k)->off + a_arr_hlspan_index(spans, k)->len)
+			break;
+	*hint = k;
+	if (k >= a_arrp_len(spans) || off < (span = a_arr_hlspan_index(spans, k))->off)
+		return A_HL_NONE;
+	if (span->type == A_HL_STRING && hl->hl_end.dq) {
+		qline = a_arr_len(hl->hl_lines) - hl->hl_end.qback;
+		if (i > qline || (i == qline && off >= hl->hl_end.qoff))
+			return A_HL_ERROR;
+	}
+	return span->type;
+}
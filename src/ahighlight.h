@@ -0,0 +1,105 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#ifndef AHIGHLIGHT_H
+#define AHIGHLIGHT_H
+
+#include "acommon.h"
+#include "aarray.h"
+#include "atoken.h"
+
+
+/* highlight types */
+enum a_hltype {
+	A_HL_NONE = 0,
+	A_HL_COMMAND, /* command name */
+	A_HL_OPERATOR, /* redirections, pipes and separators */
+	A_HL_STRING, /* inside of '"' */
+	A_HL_ERROR, /* '"' that is not closed */
+	A_HL_COUNT,
+};
+
+/* span of the input line with the same highlight */
+struct a_hlspan {
+	a_uint32 off; /* offset from the start of the line */
+	a_uint32 len;
+	a_ubyte type;
+};
+
+ARRAY_NEW(a_arr_hlspan, struct a_hlspan)
+
+/*
+ * Lexer (and grammar) state at the start of an input line, it
+ * only depends on the lines above, so it is a checkpoint from
+ * where the lexing can continue.
+ */
+struct a_hlstate {
+	a_ubyte cmd; /* next word is a command name */
+	a_ubyte redir; /* next word is a redirection target */
+	a_ubyte dq; /* line starts inside of a '"' */
+	a_ubyte word; /* highlight of the word that continues ('dq') */
+	a_uint32 qback; /* lines back to the line of the opening '"' ('dq') */
+	a_uint32 qoff; /* offset of the opening '"' in that line ('dq') */
+};
+
+struct a_hlline {
+	struct a_hlstate start;
+	a_arr_hlspan spans; /* ascending */
+};
+
+ARRAY_NEW(a_arr_hlline, struct a_hlline)
+
+/*
+ * Syntax highlighting of the input, lines are lexed with
+ * 'a_lexer_next()' one at a time starting from the state saved
+ * at their start. Edits mark the lines that changed and only
+ * those get lexed again, lexing continues past them until the
+ * state at the start of a line converges with the saved one.
+ */
+struct a_highlight {
+	a_arr_hlline hl_lines; /* parallel to the input lines */
+	struct a_hlstate hl_end; /* state at the end of the input */
+	a_uint32 hl_from; /* first changed line */
+	a_uint32 hl_to; /* last changed line, 'A_HL_ALL' if unknown */
+	a_int32 hl_delta; /* change of the number of lines */
+	a_ubyte hl_dirty;
+	a_arr_char hl_text; /* line being lexed */
+};
+
+/* 'hl_to' of the edit that can change all of the lines after 'hl_from' */
+#define A_HL_ALL ((a_uint32)-1)
+
+
+void a_highlight_init(struct a_highlight *hl);
+void a_highlight_free(struct a_highlight *hl);
+
+/*
+ * Mark the input lines ['from', 'to'] as changed (indices after
+ * the edit), number of input lines changed by 'delta'.
+ */
+void a_highlight_edit(struct a_highlight *hl, a_uint32 from, a_uint32 to, a_int32 delta);
+
+/* Lex the changed input lines (see 'A_IGB' and 'A_ILINES'). */
+void a_highlight_update(struct a_highlight *hl);
+
+/*
+ * Highlight of the byte at the offset 'off' of the input line 'i',
+ * 'hint' is the index of the span to start from, it should be 0
+ * at the start of the line and then increase with the 'off'.
+ */
+a_ubyte a_highlight_at(const struct a_highlight *hl, a_uint32 i, a_uint32 off, a_uint32 *hint);
+
+#endif
@@ -3,209 +3,382 @@
 #include "autils.h"
 #include "aalloc.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
-ASHE_PRIVATE struct a_histnode *newnode(const char *contents)
+
+/* FNV-1a */
+ASHE_PRIVATE a_uint32 hashcmd(const char *s, a_uint32 len)
 {
-	struct a_histnode *hnode;
+	a_uint32 h;
 
-	hnode = ashe_malloc(sizeof(*hnode));
-	hnode->contents = contents;
-	hnode->len = strlen(contents);
-	return hnode;
+	for (h = 2166136261u; len--; s++)
+		h = (h ^ (a_ubyte)*s) * 16777619u;
+	return h;
 }
 
 
-ASHE_PRIVATE void freenode(struct a_histnode *node)
+/* Double the 'ring', entries keep their ids. */
+ASHE_PRIVATE void growring(struct a_histlist *hl)
 {
-	ashe_free((void*)node->contents);
-	ashe_free(node);
+	struct a_histent *ring;
+	a_uint32 cap, id;
+
+	cap = (hl->ringcap ? hl->ringcap * 2 : 64);
+	ring = ashe_malloc(sizeof(*ring) * cap);
+	for (id = hl->firstid; id != hl->nextid; id++)
+		ring[id & (cap - 1)] = *ashe_histent(hl, id);
+	ashe_free(hl->ring);
+	hl->ring = ring;
+	hl->ringcap = cap;
 }
 
 
-ASHE_PRIVATE inline void checknodelimit(struct a_histlist *hl)
+/* Entry of the new newest command, its text is not set. */
+ASHE_PRIVATE struct a_histent *pushent(struct a_histlist *hl)
 {
-	struct a_histnode *hnode;
+	if (a_unlikely(ashe_histcount(hl) == hl->ringcap))
+		growring(hl);
+	return ashe_histent(hl, hl->nextid++);
+}
+
 
-	if (a_unlikely(hl->nnodes >= ASHE_HISTLIMIT)) {
-		ashe_assert(hl->nnodes > 0 && hl->tail != NULL);
-		hnode = hl->tail;
-		hl->tail = hl->tail->next;
-		hl->tail->prev = NULL;
-		freenode(hnode);
-		hl->nnodes--;
+/*
+ * Append 'len' bytes of 's' (null terminated) to the 'arena',
+ * returns their offset. Texts of the expired commands are at
+ * the start of the 'arena', once they take up at least half of
+ * it they get dropped instead of growing it.
+ */
+ASHE_PRIVATE a_memmax pushtext(struct a_histlist *hl, const char *s, a_uint32 len)
+{
+	a_memmax dead, off;
+
+	if (a_unlikely(hl->arenalen + len + 1 > hl->arenacap)) {
+		dead = (ashe_histcount(hl) > 0 ? ashe_histent(hl, hl->firstid)->off - hl->arenabase :
+						 hl->arenalen);
+		if (dead > 0 && dead >= hl->arenalen / 2) {
+			memmove(hl->arena, hl->arena + dead, hl->arenalen - dead);
+			hl->arenalen -= dead;
+			hl->arenabase += dead;
+		}
+		if (hl->arenalen + len + 1 > hl->arenacap) {
+			for (hl->arenacap = a_max(hl->arenacap, 4096);
+			     hl->arenalen + len + 1 > hl->arenacap; hl->arenacap *= 2);
+			hl->arena = ashe_realloc(hl->arena, hl->arenacap);
+		}
 	}
+	off = hl->arenabase + hl->arenalen;
+	memcpy(hl->arena + hl->arenalen, s, len);
+	hl->arena[hl->arenalen + len] = '\0';
+	hl->arenalen += len + 1;
+	return off;
 }
 
 
-ASHE_PUBLIC struct a_histnode *ashe_newhisthead(struct a_histlist *hl, const char *contents)
+/* Index the command 'id' for searching, it is the newest one. */
+ASHE_PRIVATE void indexent(struct a_histlist *hl, a_uint32 id)
 {
-	struct a_histnode *hnode;
+	const char *text;
+	a_uint32 len;
 
-	checknodelimit(hl);
-	hnode = newnode(contents);
-	hnode->prev = hl->head;
-	hnode->next = NULL;
-	if (!hl->head)
-		hl->tail = hnode;
-	else
-		hl->head->next = hnode;
-	hl->head = hnode;
-	hl->nnodes++;
-	return hnode;
+	text = ashe_histtext(hl, id);
+	len = ashe_histlen(hl, id);
+	a_trigram_add(&hl->trigrams, id, text, len);
+	a_trie_add(&hl->prefixes, id, text, len);
 }
 
 
-ASHE_PUBLIC struct a_histnode *ashe_newhisttail(struct a_histlist *hl, const char *contents)
+/*
+ * Slot of the command with the text 's' ('len' bytes long) in
+ * 'dups' (linear probing), it is empty if there is none.
+ */
+ASHE_PRIVATE a_uint32 *dupslot(struct a_histlist *hl, const char *s, a_uint32 len)
 {
-	struct a_histnode *hnode;
+	a_uint32 i, mask, *slot;
 
-	checknodelimit(hl);
-	hnode = newnode(contents);
-	hnode->next = hl->tail;
-	hnode->prev = NULL;
-	if (!hl->tail)
-		hl->head = hnode;
-	else
-		hl->tail->prev = hnode;
-	hl->tail = hnode;
-	hl->nnodes++;
-	return hnode;
+	mask = hl->dupscap - 1;
+	for (i = hashcmd(s, len) & mask; *(slot = &hl->dups[i]) != A_HIST_NONE; i = (i + 1) & mask)
+		if (ashe_histlen(hl, *slot) == len && memcmp(ashe_histtext(hl, *slot), s, len) == 0)
+			break;
+	return slot;
 }
 
 
-ASHE_PUBLIC const char *ashe_histprev(struct a_histlist *hl)
+/*
+ * Put the command 'id' (newer than any in 'dups') into 'dups',
+ * command with the same text that is already there gets erased.
+ * Returns the erased id or 'A_HIST_NONE'.
+ */
+ASHE_PRIVATE a_uint32 dupreplace(struct a_histlist *hl, a_uint32 id)
 {
-	if (!hl->current) {
-		hl->current = hl->head;
-		if (hl->current)
-			return hl->current->contents;
-	} else if (hl->current->prev) {
-		hl->current = hl->current->prev;
-		return hl->current->contents;
+	a_uint32 old, *slot;
+
+	slot = dupslot(hl, ashe_histtext(hl, id), ashe_histlen(hl, id));
+	old = *slot;
+	*slot = id;
+	if (old != A_HIST_NONE) {
+		ashe_histent(hl, old)->erased = 1;
+		hl->nerased++;
 	}
-	return NULL;
+	return old;
 }
 
 
-ASHE_PUBLIC const char *ashe_histnext(struct a_histlist *hl)
+/*
+ * Build 'dups' with 'cap' slots (power of 2) from the commands
+ * that are not erased, the older ones with the same text as a
+ * newer one get erased.
+ */
+ASHE_PRIVATE void dupsbuild(struct a_histlist *hl, a_uint32 cap)
 {
-	if (hl->current) {
-		if (!hl->current->next) {
-			hl->current = NULL;
-			return "";
-		} else {
-			hl->current = hl->current->next;
-			return hl->current->contents;
-		}
-	}
-	return NULL;
+	a_uint32 id;
+
+	ashe_free(hl->dups);
+	hl->dupscap = cap;
+	hl->dups = ashe_malloc(sizeof(*hl->dups) * cap);
+	memset(hl->dups, 0xff, sizeof(*hl->dups) * cap);
+	for (id = hl->firstid; id != hl->nextid; id++)
+		if (!ashe_histent(hl, id)->erased)
+			dupreplace(hl, id);
 }
 
 
+/* Make room in 'dups' for one more command. */
+ASHE_PRIVATE inline void dupsreserve(struct a_histlist *hl)
+{
+	if (a_unlikely((ashe_histcount(hl) - hl->nerased + 1) * 2 > hl->dupscap))
+		dupsbuild(hl, (hl->dupscap ? hl->dupscap * 2 : 64));
+}
 
-/* -------------------------------------------------------------------------
- * histbuff
- * ------------------------------------------------------------------------- */
 
 /*
- * Size of 'buffer' in 'histbuff'.
- * The size is equal to 'MAXCMDSIZE' which is the
- * maximum size of command + one byte for newline
- * character (that is how each line is saved inside
- * of history file).
- * This value ideally should be page size aligned.
+ * Remove the command 'id' from 'dups', the commands after it
+ * in the probe sequence are moved back to keep it unbroken.
  */
-#define HISTBUFFSIZE 	(MAXCMDSIZE + 1)
+ASHE_PRIVATE void dupremove(struct a_histlist *hl, a_uint32 id)
+{
+	a_uint32 i, j, k, mask;
+
+	mask = hl->dupscap - 1;
+	i = dupslot(hl, ashe_histtext(hl, id), ashe_histlen(hl, id)) - hl->dups;
+	ashe_assert(hl->dups[i] == id);
+	for (j = (i + 1) & mask; hl->dups[j] != A_HIST_NONE; j = (j + 1) & mask) {
+		k = hashcmd(ashe_histtext(hl, hl->dups[j]), ashe_histlen(hl, hl->dups[j])) & mask;
+		if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+			hl->dups[i] = hl->dups[j];
+			i = j;
+		}
+	}
+	hl->dups[i] = A_HIST_NONE;
+}
 
-struct histbuff {
-	FILE *fp;
-	a_ssize nread; /* unread bytes */
-	a_int32 pos; /* position in 'buffer' */
-	char buffer[HISTBUFFSIZE];
-};
+
+/* Drop the erased commands from the start of the 'ring'. */
+ASHE_PRIVATE void dropfirsterased(struct a_histlist *hl)
+{
+	while (hl->firstid != hl->nextid && ashe_histent(hl, hl->firstid)->erased) {
+		hl->firstid++;
+		hl->nerased--;
+	}
+	a_trigram_expire(&hl->trigrams, hl->firstid);
+}
 
 
-ASHE_PRIVATE void inithistbuff(struct histbuff *buff)
+/* Remove the oldest command. */
+ASHE_PRIVATE void expireoldest(struct a_histlist *hl)
 {
-	buff->fp = NULL;
-	buff->pos = 0;
-	buff->nread = 0;
+	dropfirsterased(hl);
+	a_trie_remove(&hl->prefixes, hl->firstid, ashe_histtext(hl, hl->firstid),
+		      ashe_histlen(hl, hl->firstid));
+	if (ASHE_HISTERASEDUPS)
+		dupremove(hl, hl->firstid);
+	hl->firstid++;
+	dropfirsterased(hl);
 }
 
 
-ASHE_PRIVATE void fillhistbuff(struct histbuff *buff)
+/*
+ * Renumber the commands without the erased ones, their texts are
+ * moved together in the 'arena' and the indexes are built again.
+ */
+ASHE_PRIVATE void renumber(struct a_histlist *hl)
 {
-	a_ssize rsize;
-	a_int32 saverrno;
+	struct a_histent *ent;
+	const char *text;
+	a_uint32 id, newid;
+	a_memmax len;
+
+	for (id = newid = hl->firstid, len = 0; id != hl->nextid; id++) {
+		ent = ashe_histent(hl, id);
+		if (ent->erased)
+			continue;
+		text = ashe_histtext(hl, id);
+		memmove(hl->arena + len, text, ent->len + 1);
+		*ashe_histent(hl, newid) = (struct a_histent){ hl->arenabase + len, ent->len, 0 };
+		len += ashe_histlen(hl, newid) + 1;
+		newid++;
+	}
+	hl->arenalen = len;
+	hl->nextid = newid;
+	hl->nerased = 0;
+	a_trigram_free(&hl->trigrams);
+	a_trie_free(&hl->prefixes);
+	for (id = hl->firstid; id != hl->nextid; id++)
+		indexent(hl, id);
+	dupsbuild(hl, hl->dupscap);
+}
 
-	ashe_assert(buff->fp != NULL);
-	ashe_assert(buff->nread == 0);
 
-	rsize = HISTBUFFSIZE - buff->pos;
-	buff->nread = fread(&buff->buffer[buff->pos], 1, rsize, buff->fp);
-	if (a_unlikely(buff->nread != rsize && ferror(buff->fp))) {
-		saverrno = errno; /* in case 'fclose' fails */
-		fclose(buff->fp);
-		errno = saverrno;
-		ashe_panic_libcall("fread");
+/*
+ * Add the newest command 'contents' ('len' bytes long), it gets
+ * copied into the history, the oldest command expires once there
+ * are 'ASHE_HISTLIMIT' of them. If 'ASHE_HISTERASEDUPS' is set,
+ * command with the same text is erased instead (found by hash).
+ * Returns the id of the command.
+ */
+ASHE_PUBLIC a_uint32 ashe_newhisthead(struct a_histlist *hl, const char *contents, a_uint32 len)
+{
+	struct a_histent *ent;
+	a_memmax off;
+	a_uint32 id;
+
+	if (a_unlikely(ashe_histcount(hl) - hl->nerased >= ASHE_HISTLIMIT) &&
+	    !(ASHE_HISTERASEDUPS && *dupslot(hl, contents, len) != A_HIST_NONE))
+		expireoldest(hl);
+	if (ASHE_HISTERASEDUPS)
+		dupsreserve(hl);
+	off = pushtext(hl, contents, len);
+	id = hl->nextid;
+	ent = pushent(hl);
+	*ent = (struct a_histent){ off, len, 0 };
+	indexent(hl, id);
+	if (ASHE_HISTERASEDUPS && dupreplace(hl, id) != A_HIST_NONE) {
+		dropfirsterased(hl);
+		if (a_unlikely(hl->nerased > ashe_histcount(hl) - hl->nerased)) {
+			renumber(hl);
+			id = hl->nextid - 1;
+		}
 	}
+	return id;
 }
 
 
-ASHE_PRIVATE const char *gethistline(struct histbuff *buff)
+/* Erased commands are skipped. */
+ASHE_PUBLIC const char *ashe_histprev(struct a_histlist *hl)
 {
-	const char *buffp;
-	const char *base;
-	a_int32 len;
-	a_int32 toread;
-	a_ubyte haveline;
+	a_uint32 id;
 
-	ashe_assert(buff->pos > 0 || buff->nread > 0);
+	id = (hl->current == A_HIST_NONE ? hl->nextid : hl->current);
+	while (id-- != hl->firstid)
+		if (!ashe_histent(hl, id)->erased)
+			return ashe_histtext(hl, (hl->current = id));
+	return NULL;
+}
 
-	haveline = 0;
-	toread = buff->nread;
-	base = buff->buffer + buff->pos;
-	buffp = base;
-	len = 0;
 
-	while (buff->nread > 0 && (buffp = ashe_strnchr(buffp, buff->nread, '\n'))) {
-		buff->pos = (buffp - buff->buffer) + 1; /* +1 to skip newline */
-		len = buffp - base;
-		buff->nread = toread - len - 1;
-		if (!ashe_isescaped(base, len) && !ashe_indq(base, len)) {
-			haveline = 1;
-			break;
+ASHE_PUBLIC const char *ashe_histnext(struct a_histlist *hl)
+{
+	if (hl->current == A_HIST_NONE)
+		return NULL;
+	while (++hl->current != hl->nextid)
+		if (!ashe_histent(hl, hl->current)->erased)
+			return ashe_histtext(hl, hl->current);
+	hl->current = A_HIST_NONE;
+	return "";
+}
+
+
+/*
+ * Find the first occurrence of 'pattern' in the command 'id',
+ * sets 'pos' to its offset. Erased commands are never found.
+ */
+ASHE_PRIVATE a_ubyte entfind(struct a_histlist *hl, a_uint32 id, const char *pattern,
+			     a_uint32 len, a_uint32 *pos)
+{
+	const char *text, *p, *end;
+
+	if (ashe_histlen(hl, id) < len || ashe_histent(hl, id)->erased)
+		return 0;
+	text = ashe_histtext(hl, id);
+	end = text + ashe_histlen(hl, id) - len;
+	for (p = text; p <= end && (p = memchr(p, *pattern, end - p + 1)); p++) {
+		if (memcmp(p, pattern, len) == 0) {
+			*pos = p - text;
+			return 1;
 		}
-		buffp++; /* skip newline */
 	}
+	return 0;
+}
 
-	if (!haveline && !feof(buff->fp)) {
-		if (a_unlikely(base == buff->buffer)) { /* command overflows ? */
-			fclose(buff->fp);
-			ashe_panicf("Unescaped quotes ('\"') in history file, "
-				"please remove or clear the history file! "
-				"According to the 'aconf.h' history file "
-				"is located at '%s'.", ASHE_HISTFILEPATH);
-		}
-		buff->pos += buff->nread;
-		buff->nread = 0;
-		len = HISTBUFFSIZE - (base - buff->buffer);
-		memmove(buff->buffer, base, len);
-		buff->pos = len;
-		fillhistbuff(buff);
-		return gethistline(buff);
-	} else {
-		if (!haveline) { /* file ends without newline char ? */
-			buff->pos += buff->nread;
-			ashe_assert(buff->pos <= HISTBUFFSIZE);
-			ashe_assert(&base[toread-1] == &buff->buffer[buff->pos-1]);
-			buff->nread = 0;
-			len = toread;
+
+/*
+ * Find the newest command older than 'before' that contains
+ * 'pattern' ('len' bytes long, at least 1), 'pos' is set to the
+ * offset of the 'pattern' in that command. Returns its id or
+ * 'A_HIST_NONE' if there is none.
+ * Only the commands that contain the rarest trigram of the
+ * 'pattern' get compared (see 'atrigram.h'), shorter patterns
+ * are compared against each command.
+ */
+ASHE_PUBLIC a_uint32 ashe_histsearch(struct a_histlist *hl, const char *pattern, a_uint32 len,
+				     a_uint32 before, a_uint32 *pos)
+{
+	const a_uint32 *ids, *rare;
+	a_uint32 i, n, id, nrare, lo, hi, mid;
+
+	if (before > hl->nextid)
+		before = hl->nextid;
+	if (len < 3) {
+		for (id = before; id-- > hl->firstid;)
+			if (entfind(hl, id, pattern, len, pos))
+				return id;
+		return A_HIST_NONE;
+	}
+
+	rare = NULL;
+	nrare = 0;
+	for (i = 0; i < a_trigram_count(len); i++) {
+		if (!(ids = a_trigram_get(&hl->trigrams, pattern + i, &n)))
+			return A_HIST_NONE;
+		if (!rare || n < nrare) {
+			rare = ids;
+			nrare = n;
 		}
-		if (len > 0) return ashe_dupstrn(base, len);
-		return NULL;
 	}
+	lo = 0;
+	hi = nrare;
+	while (lo < hi) { /* first id not below 'before' */
+		mid = lo + (hi - lo) / 2;
+		if (rare[mid] < before)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	while (lo-- > 0 && rare[lo] >= hl->firstid)
+		if (entfind(hl, rare[lo], pattern, len, pos))
+			return rare[lo];
+	return A_HIST_NONE;
+}
+
+
+/*
+ * Newest command that starts with 'prefix' ('len' bytes long)
+ * and is longer than it, 'A_HIST_NONE' if there is none.
+ */
+ASHE_PUBLIC a_uint32 ashe_histsuggest(struct a_histlist *hl, const char *prefix, a_uint32 len)
+{
+	a_uint32 id;
+
+	if (!a_trie_find(&hl->prefixes, prefix, len, &id))
+		return A_HIST_NONE;
+	return id;
 }
 
 
@@ -222,15 +395,76 @@ ASHE_PRIVATE void getrealfilepath(a_arr_char *buffer, const char *filepath)
 }
 
 
+/*
+ * End of the command that starts at 'start' (its newline, or 'end'
+ * if the file ends without one). Newlines are found with 'memchr()',
+ * one that is inside of '"' or escaped does not end the command (as
+ * when it was entered), only lines with '"' in them get scanned for
+ * the quotes.
+ */
+ASHE_PRIVATE const char *cmdend(const char *start, const char *end)
+{
+	const char *p, *nl;
+	a_ubyte dq;
+
+	for (dq = 0, p = start;; p = nl + 1) {
+		if (!(nl = memchr(p, '\n', end - p)))
+			return end;
+		if (memchr(p, '"', nl - p))
+			dq ^= ashe_indq(p, nl - p);
+		if (!dq && !ashe_isescaped(start, nl - start))
+			return nl;
+	}
+}
+
+
+/*
+ * Split the history file 'map' ('size' bytes) into commands, their
+ * entries (offsets into the 'map') are pushed into the history,
+ * only the newest 'ASHE_HISTLIMIT' of them are kept.
+ * Returns the number of commands, -1 if the command is too long.
+ */
+ASHE_PRIVATE a_int32 splithistoryfile(struct a_histlist *hl, const char *map, a_memmax size)
+{
+	struct a_histent *ent;
+	const char *nl, *start, *end;
+	a_int32 n;
+
+	n = 0;
+	end = map + size;
+	for (start = map; start < end; start = nl + 1) {
+		nl = cmdend(start, end);
+		if (a_unlikely(nl - start > MAXCMDSIZE))
+			return -1;
+		if (nl > start) {
+			if (ashe_histcount(hl) == ASHE_HISTLIMIT)
+				hl->firstid++;
+			ent = pushent(hl);
+			ent->off = start - map;
+			ent->len = nl - start;
+			n++;
+		}
+	}
+	return n;
+}
+
+
+/*
+ * Read the history file, it is mapped and split in a single
+ * pass, the texts of the commands that fit into the history
+ * are then copied into the 'arena' and indexed.
+ */
 ASHE_PRIVATE a_int32 readhistoryfile(struct a_histlist *hl, const char *filepath)
 {
-	const char *cmd;
-	struct histbuff buff;
+	struct a_histent *ent;
 	a_arr_char filebuff;
-	a_int32 status;
+	const char *map;
+	struct stat st;
+	a_int32 fd, n, status;
+	a_uint32 id, cap;
 
 	status = 0;
-	inithistbuff(&buff);
+	map = NULL;
 	a_arr_char_init(&filebuff);
 
 	if (!filepath)
@@ -239,33 +473,82 @@ ASHE_PRIVATE a_int32 readhistoryfile(struct a_histlist *hl, const char *filepath
 	getrealfilepath(&filebuff, filepath);
 	filepath = a_arr_ptr(filebuff);
 
-	if (a_unlikely((buff.fp = fopen(filepath, "r")) == NULL))
+	if (a_unlikely((fd = open(filepath, O_RDONLY | O_CLOEXEC)) < 0))
+		a_defer(-1);
+	if (a_unlikely(fstat(fd, &st) < 0))
+		a_defer(-1);
+	if (st.st_size == 0)
+		a_defer(0);
+	if (a_unlikely((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)) {
+		map = NULL;
 		a_defer(-1);
+	}
 
-	fillhistbuff(&buff); /* prime buffer */
-	while (!feof(buff.fp) || buff.nread > 0) {
-		if ((cmd = gethistline(&buff)) != NULL)
-			ashe_newhisthead(hl, cmd);
+	if (a_unlikely((n = splithistoryfile(hl, map, st.st_size)) < 0)) {
+		munmap((void *)map, st.st_size);
+		close(fd);
+		ashe_panicf("Unescaped quotes ('\"') in history file, "
+			    "please remove or clear the history file! "
+			    "According to the 'aconf.h' history file "
+			    "is located at '%s'.", ASHE_HISTFILEPATH);
+	}
+	hl->nfile = n;
+	for (id = hl->firstid; id != hl->nextid; id++)
+		hl->arenacap += ashe_histlen(hl, id) + 1;
+	if (hl->arenacap > 0)
+		hl->arena = ashe_malloc(hl->arenacap);
+	for (id = hl->firstid; id != hl->nextid; id++) {
+		ent = ashe_histent(hl, id);
+		memcpy(hl->arena + hl->arenalen, map + ent->off, ent->len);
+		hl->arena[hl->arenalen + ent->len] = '\0';
+		ent->off = hl->arenalen;
+		ent->erased = 0;
+		hl->arenalen += ent->len + 1;
 	}
+	if (ASHE_HISTERASEDUPS) {
+		for (cap = 64; cap < ashe_histcount(hl) * 2; cap <<= 1);
+		dupsbuild(hl, cap);
+	}
+	for (id = hl->firstid; id != hl->nextid; id++)
+		if (!ashe_histent(hl, id)->erased)
+			indexent(hl, id);
+	dropfirsterased(hl);
+	if (hl->nerased > ashe_histcount(hl) - hl->nerased)
+		renumber(hl);
 
 defer:
-	if (buff.fp) fclose(buff.fp);
+	if (map) munmap((void *)map, st.st_size);
+	if (fd >= 0) close(fd);
 	a_arr_char_free(&filebuff, NULL);
 	return status;
 }
 
 
+ASHE_PRIVATE void openhistoryfile(struct a_histlist *hl)
+{
+	hl->fd = open(a_arr_ptr(hl->filepath), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+	if (a_unlikely(hl->fd < 0 && !hl->canfail))
+		ashe_panic_libcall("open");
+}
+
+
 ASHE_PUBLIC void ashe_inithist(struct a_histlist *hl, const char *filepath, int canfail)
 {
 	memset(hl, 0, sizeof(*hl));
+	hl->current = A_HIST_NONE;
 	if (readhistoryfile(hl, filepath) < 0) {
 		if (canfail) {
-			ashe_freehistnodes(hl);
+			ashe_freehistents(hl);
 			memset(hl, 0, sizeof(*hl));
+			hl->current = A_HIST_NONE;
 		} else {
 			ashe_panic_libcall("fopen");
 		}
 	}
+	hl->canfail = canfail;
+	a_arr_char_init(&hl->filepath);
+	getrealfilepath(&hl->filepath, (filepath ? filepath : ASHE_HISTFILEPATH));
+	openhistoryfile(hl);
 }
 
 
@@ -274,44 +557,265 @@ ASHE_PUBLIC void ashe_inithist(struct a_histlist *hl, const char *filepath, int
  * Save to history file
  * ------------------------------------------------------------------------- */
 
-ASHE_PRIVATE a_int32 savehistoryfile(struct a_histlist *hl, const char *filepath)
+/*
+ * Compaction of the history file as it is on the disk, so the
+ * commands other sessions appended to it are kept. The helper
+ * thread writes its commands into the temporary file with the
+ * duplicates (all but the newest) and all but the newest
+ * 'ASHE_HISTLIMIT' of them removed. The main thread then locks
+ * the history file, appends whatever was written past 'size'
+ * in the meantime and renames the temporary file over it
+ * (see 'ashe_spawn_helper()').
+ */
+static struct {
+	pthread_t thread;
+	a_arr_char tmppath;
+	dev_t dev; /* history file that got compacted */
+	ino_t ino;
+	off_t size; /* its bytes that got compacted */
+	a_uint32 nkept; /* commands written */
+	a_int32 pipe[2]; /* helper thread writes here when done */
+	a_ubyte ok; /* temporary file written */
+	a_ubyte running; /* started and not joined yet */
+} compaction = { .pipe = { -1, -1 } };
+
+
+/* Write 'len' bytes of 'buf' with a single write, 0 if it failed. */
+ASHE_PRIVATE a_ubyte writeall(a_int32 fd, const char *buf, a_memmax len)
 {
-	FILE *fp;
-	a_arr_char buffer;
-	struct a_histnode *node;
-	size_t len;
-	a_int32 status;
+	a_ssize n;
 
+	while ((n = write(fd, buf, len)) < 0 && errno == EINTR);
+	return (n == (a_ssize)len);
+}
 
-	status = 0;
-	a_arr_char_init(&buffer);
 
-	/* early return if no history */
-	if (!hl->head) return status;
+/*
+ * Lock the history file for writing, if another session renamed
+ * its compacted file over it meanwhile, the file is opened again.
+ * Returns 0 if the history file is not opened.
+ */
+ASHE_PRIVATE a_ubyte lockhistoryfile(struct a_histlist *hl)
+{
+	struct stat fst, st;
+
+	while (hl->fd >= 0) {
+		while (flock(hl->fd, LOCK_EX) < 0)
+			if (errno != EINTR)
+				return 1; /* write without the lock */
+		if (fstat(hl->fd, &fst) < 0 || (stat(a_arr_ptr(hl->filepath), &st) == 0 &&
+						 st.st_dev == fst.st_dev && st.st_ino == fst.st_ino))
+			return 1;
+		close(hl->fd);
+		openhistoryfile(hl);
+	}
+	return 0;
+}
 
-	if (!filepath) filepath = ASHE_HISTFILEPATH;
 
-	getrealfilepath(&buffer, filepath);
-	filepath = a_arr_ptr(buffer);
+/*
+ * Write the commands of the history file 'map' ('size' bytes) into
+ * the temporary file, going from the newest one, commands already
+ * seen are skipped (open addressing set of their indexes).
+ */
+ASHE_PRIVATE a_ubyte writecompacted(const char *map, a_memmax size)
+{
+	struct a_histent *cmds, *tmp;
+	const char *start, *nl, *end;
+	a_uint32 *set, n, cap, i, j, k, mask;
+	a_ubyte ok;
+	FILE *fp;
 
-	if (a_unlikely((fp = fopen(filepath, "w")) == NULL))
-		a_defer(-1);
+	ok = 0;
+	cmds = NULL;
+	set = NULL;
+	end = map + size;
+	for (n = cap = 0, start = map; start < end; start = nl + 1) {
+		if ((nl = cmdend(start, end)) == start)
+			continue;
+		if (n == cap) {
+			cap = (cap ? cap * 2 : 1024);
+			if (!(tmp = realloc(cmds, sizeof(*cmds) * cap)))
+				goto out;
+			cmds = tmp;
+		}
+		cmds[n].off = start - map;
+		cmds[n].len = nl - start;
+		cmds[n++].erased = 1;
+	}
+	for (mask = 1; mask < n * 2; mask <<= 1);
+	mask--;
+	if (!(set = malloc(sizeof(*set) * (mask + 1))))
+		goto out;
+	memset(set, 0xff, sizeof(*set) * (mask + 1));
+	compaction.nkept = 0;
+	for (i = n; i-- > 0 && compaction.nkept < ASHE_HISTLIMIT;) {
+		start = map + cmds[i].off;
+		for (k = hashcmd(start, cmds[i].len) & mask; (j = set[k]) != (a_uint32)-1;
+		     k = (k + 1) & mask)
+			if (cmds[j].len == cmds[i].len &&
+			    memcmp(start, map + cmds[j].off, cmds[i].len) == 0)
+				break;
+		if (j == (a_uint32)-1) {
+			set[k] = i;
+			cmds[i].erased = 0;
+			compaction.nkept++;
+		}
+	}
+	if (!(fp = fopen(a_arr_ptr(compaction.tmppath), "we")))
+		goto out;
+	for (i = 0, ok = 1; i < n && ok; i++)
+		if (!cmds[i].erased)
+			ok = (fwrite(map + cmds[i].off, 1, cmds[i].len, fp) == cmds[i].len &&
+			      putc('\n', fp) != EOF);
+	ok = (fflush(fp) == 0 && fsync(fileno(fp)) == 0 && ok);
+	ok = (fclose(fp) == 0 && ok);
+out:
+	free(cmds);
+	free(set);
+	return ok;
+}
 
-	a_arr_len(buffer) = 0;
 
-	for (node = hl->tail; node; node = node->next) {
-		len = node->len;
-		a_arr_char_push_str(&buffer, node->contents, len++);
-		a_arr_char_push(&buffer, '\n');
-		if (a_unlikely(fwrite(a_arr_ptr(buffer), 1, len, fp) != len))
-			a_defer(-1);
-		a_arr_len(buffer) = 0;
+ASHE_PRIVATE void *compaction_run(void *arg)
+{
+	const struct a_histlist *hl;
+	const char *map;
+	struct stat st;
+	a_int32 fd;
+	a_ubyte done;
+
+	hl = arg;
+	compaction.ok = 0;
+	if ((fd = open(a_arr_ptr(hl->filepath), O_RDONLY | O_CLOEXEC)) >= 0) {
+		if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+		    (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+			compaction.dev = st.st_dev;
+			compaction.ino = st.st_ino;
+			compaction.size = st.st_size;
+			compaction.ok = writecompacted(map, st.st_size);
+			munmap((void *)map, st.st_size);
+		}
+		close(fd);
 	}
+	done = 1;
+	while (write(compaction.pipe[1], &done, 1) < 0 && errno == EINTR);
+	return NULL;
+}
 
-defer:
-	if (fp) fclose(fp);
+
+/* Start compacting the history file in the helper thread. */
+ASHE_PRIVATE void compaction_start(struct a_histlist *hl)
+{
+	a_arr_len(compaction.tmppath) = 0;
+	a_arr_char_push_str(&compaction.tmppath, a_arr_ptr(hl->filepath),
+			    a_arr_len(hl->filepath) - 1);
+	a_arr_char_push_str(&compaction.tmppath, ".tmp", sizeof(".tmp"));
+	if (a_likely(ashe_spawn_helper(compaction_run, hl, compaction.pipe, &compaction.thread)))
+		compaction.running = 1;
+}
+
+
+/*
+ * Append the bytes of the history file past the compacted 'size'
+ * to the temporary file 'fd', returns the number of commands in
+ * them (newlines) or -1 if it failed.
+ */
+ASHE_PRIVATE a_int32 appendtail(struct a_histlist *hl, a_int32 fd)
+{
+	char buf[BUFSIZ];
+	const char *p;
+	a_ssize n;
+	a_int32 rfd, ncmds;
+	off_t off;
+
+	if ((rfd = open(a_arr_ptr(hl->filepath), O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+	ncmds = 0;
+	off = compaction.size;
+	while ((n = pread(rfd, buf, sizeof(buf), off)) != 0) {
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 || !writeall(fd, buf, n)) {
+			ncmds = -1;
+			break;
+		}
+		for (p = buf; (p = memchr(p, '\n', buf + n - p)); p++)
+			ncmds++;
+		off += n;
+	}
+	close(rfd);
+	return ncmds;
+}
+
+
+/*
+ * Join the helper thread, then with the history file locked append
+ * its tail to the temporary file and rename it over the history file,
+ * which gets opened for appending again. Nothing changes if another
+ * session renamed its compacted file over it meanwhile.
+ */
+ASHE_PRIVATE void compaction_finish(struct a_histlist *hl)
+{
+	struct stat st;
+	a_int32 fd, ntail;
+	a_ubyte locked;
+
+	pthread_join(compaction.thread, NULL);
+	compaction.running = 0;
+	fd = -1;
+	locked = 0;
+	if (!compaction.ok || !(locked = lockhistoryfile(hl)))
+		goto fail;
+	if (fstat(hl->fd, &st) < 0 || st.st_dev != compaction.dev || st.st_ino != compaction.ino)
+		goto fail;
+	if ((fd = open(a_arr_ptr(compaction.tmppath), O_WRONLY | O_APPEND | O_CLOEXEC)) < 0 ||
+	    (ntail = appendtail(hl, fd)) < 0 ||
+	    rename(a_arr_ptr(compaction.tmppath), a_arr_ptr(hl->filepath)) < 0)
+		goto fail;
+	close(hl->fd); /* unlocks */
+	hl->fd = fd;
+	hl->nfile = compaction.nkept + ntail;
+	return;
+fail:
+	if (fd >= 0)
+		close(fd);
+	unlink(a_arr_ptr(compaction.tmppath));
+	if (locked)
+		flock(hl->fd, LOCK_UN);
+}
+
+
+/*
+ * Append the newest command to the history file with a single
+ * write, once the file holds more than 'ASHE_HISTFILE_COMPACT'
+ * commands it gets compacted in the background.
+ */
+ASHE_PUBLIC void ashe_histappend(struct a_histlist *hl)
+{
+	a_arr_char buffer;
+	a_ubyte done;
+
+	if (hl->fd < 0 || ashe_histcount(hl) == 0)
+		return;
+	a_arr_char_init(&buffer);
+	a_arr_char_push_str(&buffer, ashe_histtext(hl, hl->nextid - 1),
+			    ashe_histlen(hl, hl->nextid - 1));
+	a_arr_char_push(&buffer, '\n');
+	if (lockhistoryfile(hl)) {
+		if (a_unlikely(!writeall(hl->fd, a_arr_ptr(buffer), a_arr_len(buffer)) &&
+			       !hl->canfail))
+			ashe_panic("failed writing history file");
+		flock(hl->fd, LOCK_UN);
+	}
 	a_arr_char_free(&buffer, NULL);
-	return status;
+	hl->nfile++;
+	if (compaction.running) {
+		if (read(compaction.pipe[0], &done, 1) > 0)
+			compaction_finish(hl);
+	} else if (hl->nfile > ASHE_HISTFILE_COMPACT) {
+		compaction_start(hl);
+	}
 }
 
 
@@ -320,23 +824,28 @@ defer:
  * Cleanup
  * ------------------------------------------------------------------------- */
 
-ASHE_PUBLIC void ashe_freehistnodes(struct a_histlist *hl)
+ASHE_PUBLIC void ashe_freehistents(struct a_histlist *hl)
 {
-	struct a_histnode *curr;
-	struct a_histnode *prev;
-
-	curr = hl->head;
-	while (curr) {
-		prev = curr->prev;
-		freenode(curr);
-		curr = prev;
-	}
+	ashe_free(hl->ring);
+	ashe_free(hl->arena);
+	ashe_free(hl->dups);
+	a_trigram_free(&hl->trigrams);
+	a_trie_free(&hl->prefixes);
 }
 
 
-ASHE_PUBLIC void ashe_freehistlist(struct a_histlist *hl, const char *filepath, a_ubyte canfail)
+ASHE_PUBLIC void ashe_freehistlist(struct a_histlist *hl)
 {
-	if (savehistoryfile(hl, filepath) < 0 && !canfail)
-		ashe_panic("failed writing history file");
-	ashe_freehistnodes(hl);
+	if (compaction.running)
+		compaction_finish(hl);
+	a_arr_char_free(&compaction.tmppath, NULL);
+	if (compaction.pipe[0] >= 0) {
+		close(compaction.pipe[0]);
+		close(compaction.pipe[1]);
+		compaction.pipe[0] = compaction.pipe[1] = -1;
+	}
+	if (hl->fd >= 0)
+		close(hl->fd);
+	a_arr_char_free(&hl->filepath, NULL);
+	ashe_freehistents(hl);
 }
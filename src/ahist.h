@@ -2,35 +2,76 @@
 #define AHIST_H
 
 #include "acommon.h"
+#include "aarray.h"
+#include "atrigram.h"
+#include "atrie.h"
+#include "atoken.h"
 
 
-#define resethistcurrent() 	(ashe.sh_history.current = NULL)
+#define resethistcurrent() 	(ashe.sh_history.current = A_HIST_NONE)
 
+/* no command (id) */
+#define A_HIST_NONE 		((a_uint32)-1)
 
- /* commands history */
-struct a_histnode {
-	struct a_histnode *prev;
-	struct a_histnode *next;
-	const char *contents;
-	a_int32 len; /* len of 'contents' */
+/* number of commands in the history 'hl' */
+#define ashe_histcount(hl) 	((hl)->nextid - (hl)->firstid)
+
+/* entry of the command 'id' (it must be in the history) */
+#define ashe_histent(hl, id) 	(&(hl)->ring[(id) & ((hl)->ringcap - 1)])
+
+/* length and text (null terminated) of the command 'id', text
+ * is valid until the next command is added to the history */
+#define ashe_histlen(hl, id) 	(ashe_histent(hl, id)->len)
+#define ashe_histtext(hl, id) 	((hl)->arena + (ashe_histent(hl, id)->off - (hl)->arenabase))
+
+
+/* command in the history, its text is in the history 'arena' */
+struct a_histent {
+	a_memmax off; /* offset of the text (from the first one ever added) */
+	a_uint32 len; /* len of the text */
+	a_ubyte erased; /* newer command has the same text (see 'ASHE_HISTERASEDUPS') */
 };
 
 
-/* list of commands */
+/*
+ * Commands history, commands are identified by their id which
+ * ascends from the oldest one. Their entries are in the 'ring'
+ * (indexed by the id) and their texts are appended to the 'arena',
+ * the oldest command expires from the start of both of them.
+ * Erased commands stay in the 'ring' until they make up more than
+ * half of it, then the commands get renumbered without them.
+ */
 struct a_histlist {
-	a_memmax nnodes; /* total number of nodes in this list */
-	struct a_histnode *head;
-	struct a_histnode *tail;
-	struct a_histnode *current;
+	struct a_histent *ring;
+	a_uint32 ringcap; /* size of 'ring' (power of 2) */
+	a_uint32 firstid; /* id of the oldest command */
+	a_uint32 nextid; /* id of the next (newest) command */
+	a_uint32 nerased; /* erased commands in the 'ring' */
+	a_uint32 current; /* command shown in the input, 'A_HIST_NONE' if none */
+	char *arena; /* texts of the commands, oldest first */
+	a_memmax arenabase; /* offset of the 'arena' start */
+	a_memmax arenalen; /* used bytes of the 'arena' */
+	a_memmax arenacap; /* size of the 'arena' */
+	struct a_trigram trigrams; /* index of the texts for searching */
+	struct a_trie prefixes; /* index of the texts for suggestions */
+	a_uint32 *dups; /* ids by the hash of their text, 'A_HIST_NONE' if empty */
+	a_uint32 dupscap; /* size of 'dups' (power of 2) */
+	a_arr_char filepath; /* history file (expanded) */
+	a_int32 fd; /* history file opened for appending, -1 if none */
+	a_uint32 nfile; /* entries in the history file */
+	a_ubyte canfail; /* writing the history file can fail */
 };
 
 
-struct a_histnode *ashe_newhisthead(struct a_histlist *hl, const char *contents);
-struct a_histnode *ashe_newhisttail(struct a_histlist *hl, const char *contents);
+a_uint32 ashe_newhisthead(struct a_histlist *hl, const char *contents, a_uint32 len);
 const char *ashe_histprev(struct a_histlist *hl);
 const char *ashe_histnext(struct a_histlist *hl);
+a_uint32 ashe_histsearch(struct a_histlist *hl, const char *pattern, a_uint32 len,
+			 a_uint32 before, a_uint32 *pos);
+a_uint32 ashe_histsuggest(struct a_histlist *hl, const char *prefix, a_uint32 len);
+void ashe_histappend(struct a_histlist *hl);
 void ashe_inithist(struct a_histlist *hl, const char *filepath, int canfail);
-void ashe_freehistlist(struct a_histlist *hl, const char *filepath, a_ubyte canfail);
-void ashe_freehistnodes(struct a_histlist *hl);
+void ashe_freehistlist(struct a_histlist *hl);
+void ashe_freehistents(struct a_histlist *hl);
 
 #endif
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <errno.h>
+#include <poll.h>
 #include <pwd.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -32,6 +33,7 @@
 #include "ashell.h"
 #include "aasync.h"
 #include "auserstr.h"
+#include "afuzzy.h"
 #ifdef ASHE_DBG
 #include "adbg.h"
 #endif
@@ -61,6 +63,21 @@
 #define a_csi_scroll_down A_ESC(M)
 
 
+/* reverse index, at the top row scrolls the screen down */
+#define a_esc_reverse_index "\033M"
+
+
+/* synchronized output mode (DEC 2026) */
+#define a_csi_sync_begin A_ESC(?2026h)
+#define a_csi_sync_end	 A_ESC(?2026l)
+#define a_csi_sync_query A_ESC(?2026$p)
+
+
+/* bracketed paste mode */
+#define a_csi_paste_on	A_ESC(?2004h)
+#define a_csi_paste_off A_ESC(?2004l)
+
+
 /* clear control sequences */
 #define a_csi_clear_down       A_ESC(0J)
 #define a_csi_clear_up	       A_ESC(1J)
@@ -69,6 +86,19 @@
 #define a_csi_clear_line_left  A_ESC(1K)
 #define a_csi_clear_line       A_ESC(2K)
 
+/* select graphic rendition */
+#define a_csi_dim   A_ESC(2m)
+#define a_csi_reset A_ESC(0m)
+#define a_csi_reverse A_ESC(7m)
+
+/* SGR of each highlight type */
+static const char *const hlsgr[A_HL_COUNT] = {
+	[A_HL_COMMAND] = A_CSI ASHE_HL_COMMAND "m",
+	[A_HL_OPERATOR] = A_CSI ASHE_HL_OPERATOR "m",
+	[A_HL_STRING] = A_CSI ASHE_HL_STRING "m",
+	[A_HL_ERROR] = A_CSI ASHE_HL_ERROR "m",
+};
+
 
 /* key code defs */
 #define CTRL_KEY(k)    ((k) & 0x1f)
@@ -77,6 +107,10 @@
 #define IMPLEMENTED(c) (c != ESCAPE)
 
 
+/* cursor position report timeout (milliseconds) */
+#define A_CPR_TIMEOUT_MS 1000
+
+
 /* terminal column position */
 #define tcol(x) ((((x)-1) % (A_TCOLMAX)) + 1)
 
@@ -90,9 +124,9 @@
 #define dbf_pushc(c)	     a_arr_char_push(&A_TDBF, c)
 #define dbf_push(s)	     a_arr_char_push_str(&A_TDBF, s, strlen(s))
 #define dbf_push_len(s, len) a_arr_char_push_str(&A_TDBF, s, len)
-#define dbf_push_movecol(n)  a_arr_char_push_strf(&A_TDBF, A_CSI "%nG", n)
-#define dbf_push_moveup(n)   a_arr_char_push_strf(&A_TDBF, A_CSI "%nA", n)
-#define dbf_push_movedown(n) a_arr_char_push_strf(&A_TDBF, A_CSI "%nB", n)
+#define dbf_push_movecol(n)  dbf_push_csin(n, 'G')
+#define dbf_push_moveup(n)   dbf_push_csin(n, 'A')
+#define dbf_push_movedown(n) dbf_push_csin(n, 'B')
 #define dbf_pushlit(strlit)  dbf_push_len(strlit, SS(strlit))
 
 
@@ -100,25 +134,15 @@
 #define draw_lit(strlit) ashe_write(STDERR_FILENO, strlit, SS(strlit))
 
 
-/* turn on OPOST in raw mode */
-#define opost_on() \
-	{ ashe.sh_term.tm_rawtermios.c_oflag |= OPOST; \
-	  ashe_tcsetattr(TCSAFLUSH, &A_TIORAW); }
+/* word delimiter in the input buffer (word motions) */
+#define isworddelim(c) ((c) == ' ' || (c) == '\n')
 
 
-/* turn off OPOST in raw mode */
-#define opost_off() \
-	{ ashe.sh_term.tm_rawtermios.c_oflag &= ~(OPOST); \
-	  ashe_tcsetattr(TCSAFLUSH, &A_TIORAW); }
-
-
-/*
- * shift lines starting from 'row', 'n' bytes
- * to right or left depending on the 'sign'
- */
-#define shift_lines_from(row, n, sign) \
-	for (a_uint32 i = row; i < A_ILINES.len; i++) \
-		a_arr_line_index(&A_ILINES, i)->start sign## = (n);
+/* clear frame 'fr' (no rows) */
+#define frame_clear(fr) \
+	{ a_arr_len((fr)->fr_text) = 0; \
+	  a_arr_len((fr)->fr_rows) = 0; \
+	  (fr)->fr_hl = A_HL_NONE; }
 
 
 /* Implemented keys */
@@ -131,29 +155,285 @@ enum termkey {
 	HOME_KEY,
 	END_KEY,
 	DEL_KEY,
+	PASTE_KEY,
+	UTF8_KEY,
 };
 
-ASHE_PRIVATE inline void dbf_flush()
+/*
+ * Raw mode keeps OPOST off, everything pushed into 'A_TDBF'
+ * must already use "\r\n" for newlines (see 'dbf_push_moveto()').
+ * Partial writes are continued, each one is counted.
+ */
+ASHE_PUBLIC void a_term_flush(void)
 {
-	opost_on();
-	ashe_write(STDERR_FILENO, a_arr_ptr(A_TDBF), a_arr_len(A_TDBF));
-	opost_off();
+	const char *p;
+	a_memmax left;
+	a_ssize n;
+
+	if ((left = a_arr_len(A_TDBF)) == 0)
+		return;
+	p = a_arr_ptr(A_TDBF);
+	A_TOS.os_lastbytes = left;
+	A_TOS.os_lastwrites = 0;
+	while (left > 0) {
+		errno = 0;
+		if (a_unlikely((n = write(STDERR_FILENO, p, left)) < 0)) {
+			if (errno == EINTR)
+				continue;
+			ashe_panic_libcall(write);
+		}
+		A_TOS.os_lastwrites++;
+		p += n;
+		left -= n;
+	}
+	A_TOS.os_frames++;
+	A_TOS.os_bytes += A_TOS.os_lastbytes;
+	A_TOS.os_writes += A_TOS.os_lastwrites;
 	a_arr_len(A_TDBF) = 0;
 }
 
+/* Push control sequence with a single numeric parameter 'n'. */
+ASHE_PRIVATE void dbf_push_csin(a_uint32 n, char final)
+{
+	char buf[SS(A_CSI) + ASHE_MAXINT32STR + 1];
+	char *p;
+
+	p = buf + sizeof(buf);
+	*--p = final;
+	do {
+		*--p = '0' + (n % 10);
+	} while ((n /= 10));
+	*--p = '[';
+	*--p = ESCAPE;
+	dbf_push_len(p, buf + sizeof(buf) - p);
+}
+
+ASHE_PRIVATE void update_prompt(void);
+ASHE_PRIVATE void expand_prompt(void);
+ASHE_PRIVATE void complete_loaded(void);
+ASHE_PRIVATE void picker_update(void);
+
+/* state of the reverse incremental history search */
+static struct {
+	a_ubyte active;
+	a_ubyte failed; /* nothing matches the 'query' */
+	a_arr_char query;
+	a_uint32 match; /* shown in the input, 'A_HIST_NONE' if none */
+	a_arr_char saved; /* input before the search */
+	a_uint32 savedidx; /* cursor index before the search */
+} hsearch;
+
+/* set while the history suggestions are shown */
+static a_ubyte suggesting;
+
+/* state of the fuzzy finder */
+static struct {
+	a_ubyte active;
+	a_uint32 sel; /* selected match */
+	struct a_fzresults res; /* listed below the input */
+	a_arr_char query; /* input the results are for */
+	a_arr_char saved; /* input before the fuzzy finder */
+	a_uint32 savedidx; /* cursor index before the fuzzy finder */
+} picker;
+
+/*
+ * Event loop of the input, waits until terminal input is
+ * available while handling signals (see 'ashe_handle_signals()'),
+ * async placeholders (see 'update_prompt()'), directory
+ * listings (see 'complete_loaded()') and fuzzy finder results
+ * (see 'picker_update()') that arrive before it.
+ * Returns 1 if terminal input is available.
+ */
+ASHE_PRIVATE a_ubyte wait_stdin(void)
+{
+	struct pollfd pfd[5];
+
+	pfd[0].fd = STDIN_FILENO;
+	pfd[1].fd = ashe_signal_fd();
+	pfd[2].fd = ashe_async_placeholders_fd(); /* ignored if -1 */
+	pfd[3].fd = ashe_pathcompl_fd();
+	pfd[4].fd = ashe_fuzzy_fd();
+	pfd[0].events = pfd[1].events = pfd[2].events = pfd[3].events = pfd[4].events = POLLIN;
+	if (poll(pfd, ASHE_ELEMENTS(pfd), -1) < 0) {
+		if (a_unlikely(errno != EINTR))
+			ashe_panic_libcall(poll);
+		return 0;
+	}
+	if (pfd[1].revents)
+		ashe_handle_signals();
+	if (pfd[2].revents)
+		update_prompt();
+	if (pfd[3].revents)
+		complete_loaded();
+	if (pfd[4].revents)
+		picker_update();
+	return (pfd[0].revents != 0);
+}
+
+/*
+ * Read bytes that are available on the terminal into the key
+ * buffer, waiting at most 'timeout' milliseconds for them.
+ * If 'timeout' is negative, block while handling events (see 'wait_stdin()').
+ * Buffer grows if it is full of bytes that were not decoded yet
+ * (keys typed ahead of a terminal reply, see 'read_cpr()').
+ * Returns the number of bytes read, or 0 on timeout.
+ */
+ASHE_PRIVATE a_uint32 kbf_fill(a_int32 timeout)
+{
+	struct pollfd pfd;
+	a_ssize nread, i;
+	a_int32 ready;
+	char *p;
+
+	if (A_TKBF.kb_pos == A_TKBF.kb_len) {
+		A_TKBF.kb_pos = A_TKBF.kb_len = 0;
+	} else if (A_TKBF.kb_len == A_TKBF.kb_cap && A_TKBF.kb_pos > 0) { /* full, compact */
+		A_TKBF.kb_len -= A_TKBF.kb_pos;
+		memmove(A_TKBF.kb_buf, A_TKBF.kb_buf + A_TKBF.kb_pos, A_TKBF.kb_len);
+		A_TKBF.kb_pos = 0;
+	} else if (A_TKBF.kb_len == A_TKBF.kb_cap) {
+		A_TKBF.kb_cap *= 2;
+		A_TKBF.kb_buf = ashe_realloc(A_TKBF.kb_buf, A_TKBF.kb_cap);
+	}
+
+	p = A_TKBF.kb_buf + A_TKBF.kb_len;
+	if (timeout < 0) {
+		do {
+			while (!wait_stdin())
+				;
+			nread = read(STDIN_FILENO, p, A_TKBF.kb_cap - A_TKBF.kb_len);
+			if (a_unlikely(nread < 0 && errno != EINTR && errno != EAGAIN))
+				ashe_panic_libcall(read);
+		} while (nread <= 0);
+	} else {
+		pfd.fd = STDIN_FILENO;
+		pfd.events = POLLIN;
+		while ((ready = poll(&pfd, 1, timeout)) < 0)
+			if (a_unlikely(errno != EINTR))
+				ashe_panic_libcall(poll);
+		if (ready == 0)
+			return 0;
+		while ((nread = read(STDIN_FILENO, p, A_TKBF.kb_cap - A_TKBF.kb_len)) < 0)
+			if (a_unlikely(errno != EINTR))
+				ashe_panic_libcall(read);
+	}
+	for (i = 0; i < nread && A_TKBF.kb_cooked > 0; i++, A_TKBF.kb_cooked--)
+		if (p[i] == '\n')
+			p[i] = CR;
+	A_TKBF.kb_len += nread;
+	return nread;
+}
+
+/*
+ * Count the typeahead (bytes typed while the last command was
+ * running), must be called right after entering raw mode.
+ * Terminal received these bytes in cooked mode which translated
+ * CR into NL, 'kbf_fill()' undoes that as it reads them (however
+ * many reads it takes) so they still behave as 'Enter' instead
+ * of 'CTRL_KEY('j')'.
+ */
+ASHE_PRIVATE void kbf_typeahead(void)
+{
+	a_int32 n;
+
+	A_TKBF.kb_cooked = (ioctl(STDIN_FILENO, FIONREAD, &n) < 0 ? 0 : a_max(n, 0));
+}
+
+/*
+ * Get the next byte from the key buffer, refill it
+ * if needed (see 'kbf_fill()'), returns -1 on timeout.
+ */
+ASHE_PRIVATE a_int32 kbf_getc(a_int32 timeout)
+{
+	if (A_TKBF.kb_pos == A_TKBF.kb_len && kbf_fill(timeout) == 0)
+		return -1;
+	return (a_ubyte)A_TKBF.kb_buf[A_TKBF.kb_pos++];
+}
+
+/*
+ * Find terminal reply 'ESC intro Pn ; ... ; Pn final' with
+ * 'nparams' numeric parameters in the key buffer and cut it
+ * out, bytes around it are kept.
+ * Parameters are stored into 'params'.
+ */
+ASHE_PRIVATE a_ubyte kbf_cutreply(const char *intro, const char *final, a_uint32 *params,
+				  a_uint32 nparams)
+{
+	char *s, *p, *end;
+	a_uint32 i, n;
+
+	end = A_TKBF.kb_buf + A_TKBF.kb_len;
+	for (s = A_TKBF.kb_buf + A_TKBF.kb_pos; (s = memchr(s, ESCAPE, end - s)); s++) {
+		p = s + 1;
+		for (n = 0; intro[n] && p < end && *p == intro[n]; n++, p++);
+		if (intro[n])
+			continue;
+		for (i = 0; i < nparams; i++) {
+			if (i > 0 && (p == end || *p++ != ';'))
+				break;
+			for (params[i] = 0; p < end && isdigit(*p); p++)
+				params[i] = params[i] * 10 + (*p - '0');
+		}
+		if (i < nparams)
+			continue;
+		for (n = 0; final[n] && p < end && *p == final[n]; n++, p++);
+		if (final[n])
+			continue;
+		memmove(s, p, end - p);
+		A_TKBF.kb_len -= p - s;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Read cursor position report, keys typed before
+ * the reply stay in the key buffer.
+ * Returns 0 if the terminal did not reply in time.
+ */
+ASHE_PRIVATE a_ubyte read_cpr(a_uint32 *row, a_uint32 *col)
+{
+	a_uint32 pos[2];
+
+	while (!kbf_cutreply("[", "R", pos, 2))
+		if (kbf_fill(A_CPR_TIMEOUT_MS) == 0)
+			return 0;
+	*row = pos[0];
+	*col = pos[1];
+	return 1;
+}
+
+/* Query the terminal for the current cursor position. */
+ASHE_PRIVATE void query_cursor(a_uint32 *row, a_uint32 *col)
+{
+	draw_lit(a_csi_cursor_position);
+	if (a_unlikely(!read_cpr(row, col)))
+		ashe_panic("terminal did not report cursor position");
+}
+
+/*
+ * Query the terminal if it supports synchronized output.
+ * Terminals reply in order, so once the cursor position
+ * report arrives, mode report (if any) is there as well.
+ */
+ASHE_PRIVATE void query_syncout(void)
+{
+	a_uint32 row, col, mode;
+
+	draw_lit(a_csi_sync_query a_csi_cursor_position);
+	A_TM.tm_syncout = (read_cpr(&row, &col) &&
+			   kbf_cutreply("[?2026;", "$y", &mode, 1) && (mode == 1 || mode == 2));
+}
+
 ASHE_PRIVATE void get_winsize_fallback(void)
 {
-	a_uint32 oldrow, oldcol;
+	a_uint32 row, col;
 
 	draw_lit(a_csi_cursor_hide a_csi_cursor_save a_csi_cursor_right(99999)
 			 a_csi_cursor_down(99999));
-	oldrow = A_TROW;
-	oldcol = A_TCOL;
-	a_term_sync_cursor();
-	A_TROWMAX = A_TROW;
-	A_TCOLMAX = A_TCOL;
-	A_TROW = oldrow;
-	A_TCOL = oldcol;
+	query_cursor(&row, &col);
+	A_TROWMAX = row;
+	A_TCOLMAX = col;
 	draw_lit(a_csi_cursor_load a_csi_cursor_show);
 }
 
@@ -169,225 +449,1578 @@ ASHE_PRIVATE void init_rawterm(struct termios *rawterm)
 	rawterm->c_cc[VTIME] = 0;
 }
 
-ASHE_PRIVATE void a_input_init()
+ASHE_PRIVATE void a_input_init()
+{
+	a_gapbuf_init(&A_IGB, 64);
+	a_arr_char_init(&A_IBF);
+	A_IBFIDX = 0;
+	/* input lines */
+	a_arr_line_init(&A_ILINES);
+	a_fenwick_init(&A_ILENFW);
+	a_fenwick_init(&A_IROWFW);
+	/* rows get computed once dimensions and prompt are known */
+	a_arr_line_push(&A_ILINES, (struct a_line){ .len = 0, .width = 0, .rows = 1 });
+	a_fenwick_push(&A_ILENFW, 0);
+	a_fenwick_push(&A_IROWFW, 1);
+	a_highlight_init(&A_IHL);
+	A_ICOL = 0;
+	A_IROW = 0;
+	/* rest is set dynamically */
+}
+
+ASHE_PRIVATE void a_input_free(void)
+{
+	a_gapbuf_free(&A_IGB);
+	a_arr_char_free(&A_IBF, NULL);
+	a_arr_line_free(&A_ILINES, NULL);
+	a_fenwick_free(&A_ILENFW);
+	a_fenwick_free(&A_IROWFW);
+	a_highlight_free(&A_IHL);
+}
+
+/* Redraw prompt, do not update cursor. */
+ASHE_PUBLIC void ashe_redraw_prompt_unsafe(void)
+{
+	dbf_pushlit(a_csi_cursor_hide);
+	dbf_push_len(a_arr_ptr(A_TP), A_TPLEN);
+	dbf_pushlit(a_csi_cursor_show);
+}
+
+/*
+ * Length in bytes of the character (or escape sequence) at 's'
+ * ('len' bytes available), its display width is stored in 'w'.
+ */
+ASHE_PRIVATE inline a_uint32 text_char(const char *s, a_uint32 len, a_uint32 *w)
+{
+	a_uint32 cp, n;
+
+	if ((a_ubyte)*s < 0x80) {
+		if (a_unlikely(*s == ESCAPE)) {
+			*w = 0;
+			return a_utf8_esclen(s, len);
+		}
+		*w = a_utf8_width((a_ubyte)*s);
+		return 1;
+	}
+	n = a_utf8_decode(s, len, &cp);
+	*w = a_utf8_width(cp);
+	return n;
+}
+
+/* Display width of the first 'len' bytes of 's'. */
+ASHE_PRIVATE a_uint32 text_width(const char *s, a_uint32 len)
+{
+	a_uint32 i, w, width;
+
+	for (i = width = 0; i < len; width += w)
+		i += text_char(s + i, len - i, &w);
+	return width;
+}
+
+/*
+ * Length in bytes of the character at the input buffer
+ * index 'idx', its display width is stored in 'w'.
+ */
+ASHE_PRIVATE a_uint32 ibf_char(a_uint32 idx, a_uint32 *w)
+{
+	char buf[4];
+	a_uint32 i, n;
+
+	buf[0] = a_gapbuf_at(&A_IGB, idx);
+	if (a_likely((a_ubyte)buf[0] < 0x80)) {
+		*w = 1; /* input holds no control characters */
+		return 1;
+	}
+	n = a_min(a_utf8_seqlen(buf[0]), a_gapbuf_len(&A_IGB) - idx);
+	for (i = 1; i < n; i++)
+		buf[i] = a_gapbuf_at(&A_IGB, idx + i);
+	return text_char(buf, n, w);
+}
+
+/*
+ * Advance the terminal position 'pos' ('row * A_TCOLMAX + col')
+ * over a character of width 'w', wide character that does not
+ * fit into the rest of the row goes onto the next row.
+ */
+ASHE_PRIVATE inline a_uint32 tadvance(a_uint32 pos, a_uint32 w)
+{
+	if (w > 1 && (pos % A_TCOLMAX) + w > A_TCOLMAX)
+		pos += A_TCOLMAX - (pos % A_TCOLMAX);
+	return pos + w;
+}
+
+/* Length of the input line 'i' excluding '\n'. */
+ASHE_PRIVATE inline a_uint32 line_maxcol(a_uint32 i)
+{
+	return a_arr_line_index(&A_ILINES, i)->len - (i < a_arr_len(A_ILINES) - 1);
+}
+
+/*
+ * Display width of the input line that starts at the input
+ * buffer index 'off' and is 'len' bytes long (excluding '\n').
+ */
+ASHE_PRIVATE a_uint32 line_measure(a_uint32 off, a_uint32 len)
+{
+	a_uint32 end, w, width;
+
+	width = 0;
+	for (end = off + len; off < end; width += w)
+		off += ibf_char(off, &w);
+	return width;
+}
+
+/*
+ * Terminal position (see 'tadvance()') after the first 'n'
+ * bytes of the input line 'i', counted from the row where
+ * the line starts (first line starts after the prompt).
+ * Multibyte characters always take fewer columns than they
+ * have bytes, so the line with the width equal to its length
+ * is plain ASCII and its position needs no scanning.
+ */
+ASHE_PRIVATE a_uint32 line_pos(a_uint32 i, a_uint32 n)
+{
+	a_uint32 pos, idx, end, w;
+
+	pos = (i == 0) * A_TPCOLS;
+	if (a_likely(a_arr_line_index(&A_ILINES, i)->width == line_maxcol(i)))
+		return pos + n;
+	idx = a_input_lineoff(i);
+	for (end = idx + n; idx < end; pos = tadvance(pos, w))
+		idx += ibf_char(idx, &w);
+	return pos;
+}
+
+/*
+ * Cursor model.
+ * Compute terminal position of the input position 'icol' in
+ * the input line 'irow' from the prompt width, input lines
+ * and terminal width.
+ * Row is relative to the terminal row where the prompt starts,
+ * column is absolute (prompt always starts in the first column).
+ * Each input line starts on a new terminal row and spans
+ * 'pos / A_TCOLMAX + 1' rows, where 'pos' is the terminal
+ * position of its end (see 'line_pos()').
+ */
+ASHE_PRIVATE void cursor_model(a_uint32 irow, a_uint32 icol, a_uint32 *row, a_uint32 *col)
+{
+	a_uint32 pos;
+
+	pos = line_pos(irow, icol);
+	*row = a_fenwick_sum(&A_IROWFW, irow) + trowdiffx(pos);
+	*col = (pos % A_TCOLMAX) + 1;
+}
+
+/* Terminal rows the input line 'i' spans (cursor model). */
+ASHE_PRIVATE a_uint32 line_rows(a_uint32 i)
+{
+	return trowdiffx(line_pos(i, line_maxcol(i))) + 1;
+}
+
+/* Compute the terminal position where the prompt ends. */
+ASHE_PRIVATE void sync_promptcols(void)
+{
+	const char *s;
+	a_uint32 i, pos, w;
+
+	s = a_arr_ptr(A_TP);
+	for (i = pos = 0; i < A_TPLEN; pos = tadvance(pos, w))
+		i += text_char(s + i, A_TPLEN - i, &w);
+	A_TPCOLS = pos;
+}
+
+/* Start of the character (cell) before the input buffer index 'idx'. */
+ASHE_PRIVATE a_uint32 char_prev(a_uint32 idx)
+{
+	a_uint32 w;
+
+	do {
+		while (--idx > 0 && a_utf8_iscont(a_gapbuf_at(&A_IGB, idx)));
+		ibf_char(idx, &w);
+	} while (w == 0 && idx > 0 && a_gapbuf_at(&A_IGB, idx - 1) != '\n');
+	return idx;
+}
+
+/* End of the character (cell) at the input buffer index 'idx'. */
+ASHE_PRIVATE a_uint32 char_next(a_uint32 idx)
+{
+	a_uint32 len, n, w;
+
+	if (a_gapbuf_at(&A_IGB, idx) == '\n')
+		return idx + 1;
+	len = a_gapbuf_len(&A_IGB);
+	for (idx += ibf_char(idx, &w); idx < len; idx += n) {
+		n = ibf_char(idx, &w);
+		if (w > 0)
+			break;
+	}
+	return idx;
+}
+
+/*
+ * Change the length of the input line 'i' by 'delta' bytes
+ * and its width by 'dwidth' columns and update its rows,
+ * number of lines must stay the same.
+ */
+ASHE_PRIVATE void line_update(a_uint32 i, a_int32 delta, a_int32 dwidth)
+{
+	struct a_line *line;
+	a_uint32 rows;
+
+	line = a_arr_line_index(&A_ILINES, i);
+	line->len += delta;
+	line->width += dwidth;
+	if (delta != 0) {
+		a_fenwick_add(&A_ILENFW, i, delta);
+		a_highlight_edit(&A_IHL, i, i, 0);
+	}
+	if ((rows = line_rows(i)) != line->rows) {
+		a_fenwick_add(&A_IROWFW, i, (a_int32)rows - (a_int32)line->rows);
+		line->rows = rows;
+	}
+}
+
+/*
+ * Recompute rows and prefix sums of the input lines
+ * starting from the line 'row' (after lines were
+ * added or removed or the terminal got resized).
+ */
+ASHE_PRIVATE void sync_lines_from(a_uint32 row)
+{
+	struct a_line *line;
+	a_uint32 i;
+
+	a_fenwick_truncate(&A_ILENFW, row);
+	a_fenwick_truncate(&A_IROWFW, row);
+	for (i = row; i < a_arr_len(A_ILINES); i++) {
+		line = a_arr_line_index(&A_ILINES, i);
+		line->rows = line_rows(i);
+		a_fenwick_push(&A_ILENFW, line->len);
+		a_fenwick_push(&A_IROWFW, line->rows);
+	}
+}
+
+/* Input line that occupies the terminal row 'row' (clamped to the last line). */
+ASHE_PRIVATE inline a_uint32 line_at(a_uint32 row)
+{
+	a_uint32 i;
+
+	i = a_fenwick_search(&A_IROWFW, row);
+	return (i < a_arr_len(A_ILINES) ? i : a_arr_len(A_ILINES) - 1);
+}
+
+/* Input line that contains the input buffer index 'idx'. */
+ASHE_PRIVATE inline a_uint32 line_of(a_uint32 idx)
+{
+	a_uint32 i;
+
+	i = a_fenwick_search(&A_ILENFW, idx);
+	return (i < a_arr_len(A_ILINES) ? i : a_arr_len(A_ILINES) - 1);
+}
+
+/*
+ * Rebuild input lines starting from the input line 'row'
+ * (lines before it must be valid), and set input row and
+ * column from the input buffer index. Edit that made the
+ * lines change ends on the line of the input buffer index.
+ */
+ASHE_PRIVATE void rebuild_lines(a_uint32 row)
+{
+	a_uint32 start, end, nl, old;
+
+	old = a_arr_len(A_ILINES);
+	start = a_input_lineoff(row);
+	end = a_gapbuf_len(&A_IGB);
+	a_arr_len(A_ILINES) = row;
+	while ((nl = a_gapbuf_chr(&A_IGB, start, '\n')) < end) {
+		a_arr_line_push(&A_ILINES, (struct a_line){ .len = nl - start + 1,
+							   .width = line_measure(start, nl - start) });
+		start = nl + 1;
+	}
+	a_arr_line_push(&A_ILINES, (struct a_line){ .len = end - start,
+						   .width = line_measure(start, end - start) });
+	sync_lines_from(row);
+	A_IROW = line_of(A_IBFIDX);
+	A_ICOL = A_IBFIDX - a_input_lineoff(A_IROW);
+	a_highlight_edit(&A_IHL, row, A_IROW, (a_int32)a_arr_len(A_ILINES) - (a_int32)old);
+}
+
+/* Set input buffer index to 'idx' and update input row and column. */
+ASHE_PRIVATE void set_cursor(a_uint32 idx)
+{
+	A_IBFIDX = idx;
+	A_IROW = line_of(idx);
+	A_ICOL = idx - a_input_lineoff(A_IROW);
+}
+
+/*
+ * Remove input buffer range ['from', 'to') in one pass,
+ * lines are rebuilt starting from the row of 'from'
+ * and the cursor ends up at 'from'.
+ */
+ASHE_PRIVATE void remove_range(a_uint32 from, a_uint32 to)
+{
+	set_cursor(from);
+	a_gapbuf_remove(&A_IGB, from, to - from);
+	rebuild_lines(A_IROW);
+}
+
+/*
+ * Inverse of the cursor model.
+ * Get input buffer index of the terminal position 'row' and
+ * 'col', index is clamped to the input line that occupies
+ * that row (and can't be inside of the prompt).
+ */
+ASHE_PRIVATE a_uint32 cursor_index(a_uint32 row, a_uint32 col)
+{
+	a_uint32 i, rows, target, start, maxcol, icol, idx, end, pos, next, w;
+
+	i = line_at(row);
+	rows = a_fenwick_sum(&A_IROWFW, i);
+	start = (i == 0) * A_TPCOLS;
+	maxcol = line_maxcol(i);
+	target = (row > rows ? row - rows : 0) * A_TCOLMAX + col - 1;
+	idx = a_input_lineoff(i);
+	if (a_likely(a_arr_line_index(&A_ILINES, i)->width == maxcol)) { /* ASCII */
+		icol = (target > start ? target - start : 0);
+		return idx + (icol < maxcol ? icol : maxcol);
+	}
+	/* stop at the character whose cell contains 'target' */
+	pos = start;
+	for (end = idx + maxcol; idx < end; idx += next) {
+		next = ibf_char(idx, &w);
+		if (w == 0) /* combining, belongs to the previous cell */
+			continue;
+		if (tadvance(pos, w) > target)
+			break;
+		pos = tadvance(pos, w);
+	}
+	return idx;
+}
+
+/* Terminal row of the end of the input (cursor model). */
+ASHE_PRIVATE inline a_uint32 input_endrow(void)
+{
+	return a_fenwick_total(&A_IROWFW) - 1;
+}
+
+/* Append escape sequence 's' to the last row of frame 'fr'. */
+ASHE_PRIVATE inline void frame_pushesc(struct a_frame *fr, const char *s)
+{
+	a_uint32 len;
+
+	len = strlen(s);
+	a_arr_char_push_str(&fr->fr_text, s, len);
+	a_arr_row_last(&fr->fr_rows)->len += len;
+}
+
+/*
+ * Append new empty row to frame 'fr', while there are rows
+ * to skip ('fr_skip') the last row is emptied instead.
+ * Rows get drawn on their own, so the highlight is reset
+ * at the end of the row and set again on the new one.
+ */
+ASHE_PRIVATE inline void frame_newrow(struct a_frame *fr)
+{
+	struct a_row *row;
+
+	if (fr->fr_hl != A_HL_NONE)
+		frame_pushesc(fr, a_csi_reset);
+	if (a_unlikely(fr->fr_skip > 0)) {
+		fr->fr_skip--;
+		row = a_arr_row_last(&fr->fr_rows);
+		a_arr_len(fr->fr_text) = row->off;
+		row->len = row->width = 0;
+	} else {
+		a_arr_row_push(&fr->fr_rows, (struct a_row){ .off = a_arr_len(fr->fr_text) });
+	}
+	if (fr->fr_hl != A_HL_NONE)
+		frame_pushesc(fr, hlsgr[fr->fr_hl]);
+}
+
+/* Highlight what gets appended to frame 'fr' next as 'type'. */
+ASHE_PRIVATE inline void frame_sethl(struct a_frame *fr, a_ubyte type)
+{
+	if (type == fr->fr_hl)
+		return;
+	if (fr->fr_hl != A_HL_NONE)
+		frame_pushesc(fr, a_csi_reset);
+	if (type != A_HL_NONE)
+		frame_pushesc(fr, hlsgr[type]);
+	fr->fr_hl = type;
+}
+
+/*
+ * Append character 's' ('len' bytes, 'w' columns) to the last
+ * row of frame 'fr', character that does not fit starts a new
+ * row (zero width characters stay with the previous one).
+ */
+ASHE_PRIVATE inline void frame_pushc(struct a_frame *fr, const char *s, a_uint32 len, a_uint32 w)
+{
+	struct a_row *row;
+
+	row = a_arr_row_last(&fr->fr_rows);
+	if (w > 0 && row->width + w > A_TCOLMAX) {
+		frame_newrow(fr);
+		row = a_arr_row_last(&fr->fr_rows);
+	}
+	a_arr_char_push_str(&fr->fr_text, s, len);
+	row->len += len;
+	row->width += w;
+}
+
+/* Check if frame 'fr' is full, rows that would not fit get dropped. */
+ASHE_PRIVATE inline a_ubyte frame_full(struct a_frame *fr)
+{
+	if (a_unlikely(a_arr_len(fr->fr_rows) > A_TROWMAX)) {
+		a_arr_len(fr->fr_rows) = A_TROWMAX;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * End the line in frame 'fr', row that got filled exactly
+ * is followed by an empty row (cursor goes there).
+ */
+ASHE_PRIVATE inline void frame_eol(struct a_frame *fr)
+{
+	if (a_arr_row_last(&fr->fr_rows)->width == A_TCOLMAX)
+		frame_newrow(fr);
+}
+
+/*
+ * Append character 's' ('len' bytes, 'w' columns) to frame 'fr'
+ * (newline starts a new row), returns 0 once the frame is full
+ * ('A_TROWMAX' rows).
+ */
+ASHE_PRIVATE inline a_ubyte frame_put(struct a_frame *fr, const char *s, a_uint32 len, a_uint32 w)
+{
+	if (*s == '\n') {
+		frame_eol(fr);
+		frame_newrow(fr);
+	} else {
+		frame_pushc(fr, s, len, w);
+	}
+	return !frame_full(fr);
+}
+
+/*
+ * Newest history entry that starts with the input and is longer
+ * than it, suggested only while the cursor is at the end of the input.
+ */
+ASHE_PRIVATE a_uint32 suggestion(void)
+{
+	a_uint32 len;
+
+	len = a_gapbuf_len(&A_IGB);
+	if (!suggesting || hsearch.active || picker.active || len == 0 || A_IBFIDX != len)
+		return A_HIST_NONE;
+	return ashe_histsuggest(&ashe.sh_history, a_gapbuf_prefix(&A_IGB, len), len);
+}
+
+/*
+ * Append the rest of the suggested command 'id' dimmed to the last row
+ * of frame 'fr', it ends at the first control character or at the
+ * last column of the row (cursor model does not know about it).
+ */
+ASHE_PRIVATE void frame_suggestion(struct a_frame *fr, a_uint32 id)
+{
+	const char *s;
+	a_uint32 k, n, w, len, left, width;
+
+	s = ashe_histtext(&ashe.sh_history, id) + a_gapbuf_len(&A_IGB);
+	len = ashe_histlen(&ashe.sh_history, id) - a_gapbuf_len(&A_IGB);
+	left = A_TCOLMAX - a_arr_row_last(&fr->fr_rows)->width - 1;
+	for (k = width = 0; k < len && !iscntrl((a_ubyte)s[k]); k += n, width += w) {
+		n = text_char(s + k, len - k, &w);
+		if (width + w > left)
+			break;
+	}
+	if (k == 0)
+		return;
+	frame_pushc(fr, a_csi_dim, SS(a_csi_dim), 0);
+	frame_pushc(fr, s, k, width);
+	frame_pushc(fr, a_csi_reset, SS(a_csi_reset), 0);
+}
+
+/* Rows listing the fuzzy finder matches below the input. */
+#define picker_rows() (picker.active ? picker.res.nmatches : 0)
+
+/*
+ * Append the fuzzy finder matches to frame 'fr', each on its
+ * own row (selected one in reverse video), they end at the
+ * first control character or at the last column.
+ */
+ASHE_PRIVATE void frame_picker(struct a_frame *fr)
+{
+	const char *s;
+	a_uint32 i, k, n, w, len, width;
+	a_ubyte ishist;
+
+	for (i = 0; i < picker.res.nmatches; i++) {
+		frame_newrow(fr);
+		if (frame_full(fr))
+			return;
+		s = ashe_fuzzy_candidate(picker.res.matches[i].idx, &len, &ishist);
+		if (i == picker.sel)
+			frame_pushesc(fr, a_csi_reverse);
+		frame_pushc(fr, (i == picker.sel ? "> " : "  "), 2, 2);
+		for (k = 0, width = 2; k < len && !iscntrl((a_ubyte)s[k]); k += n, width += w) {
+			n = text_char(s + k, len - k, &w);
+			if (width + w > A_TCOLMAX - 1)
+				break;
+			frame_pushc(fr, s + k, n, w);
+		}
+		if (i == picker.sel)
+			frame_pushesc(fr, a_csi_reset);
+	}
+}
+
+/* Insert the rest of the suggested history entry. */
+ASHE_PRIVATE void accept_suggestion(void)
+{
+	a_uint32 id, len;
+
+	if ((id = suggestion()) != A_HIST_NONE) {
+		len = a_gapbuf_len(&A_IGB);
+		ashe_insert_str(ashe_histtext(&ashe.sh_history, id) + len,
+				ashe_histlen(&ashe.sh_history, id) - len);
+	}
+}
+
+/*
+ * Lay out the viewport of the prompt and the input (if reading)
+ * into the frame 'fr' the same way cursor model does, frame row 0
+ * is the row 'A_TVTOP'.
+ * Rows break at the terminal width and after each newline, row
+ * that got filled exactly is followed by an empty row, which is
+ * where the cursor goes after the last column. History suggestion
+ * follows the input on its last row, fuzzy finder matches are
+ * listed below it.
+ * Lines above the viewport are skipped without being looked at,
+ * rows of the first line above the viewport are skipped directly
+ * if the line is ASCII, otherwise they get laid out and dropped,
+ * so the cost is bounded by the terminal size and a single line.
+ */
+ASHE_PRIVATE void layout(struct a_frame *fr)
+{
+	const char *s;
+	char c[4];
+	a_uint32 i, pos, end, skip, n, w, k, off, hint, id;
+	a_ubyte hl;
+
+	frame_clear(fr);
+	fr->fr_skip = 0;
+	frame_newrow(fr);
+	i = line_at(A_TVTOP);
+	skip = A_TVTOP - a_fenwick_sum(&A_IROWFW, i);
+	pos = a_input_lineoff(i);
+	if (i > 0 && a_arr_line_index(&A_ILINES, i)->width == line_maxcol(i))
+		pos += skip * A_TCOLMAX;
+	else
+		fr->fr_skip = skip;
+	if (i == 0) { /* prompt is part of the first line */
+		s = a_arr_ptr(A_TP);
+		for (k = 0; k < A_TPLEN; k += n) {
+			n = text_char(s + k, A_TPLEN - k, &w);
+			if (!frame_put(fr, s + k, n, w))
+				return;
+		}
+	}
+	if (A_TM.tm_reading) {
+		if ((hl = !picker.active)) /* query is not a command */
+			a_highlight_update(&A_IHL);
+		end = a_gapbuf_len(&A_IGB);
+		off = pos - a_input_lineoff(i);
+		hint = 0;
+		for (; pos < end; pos += n) {
+			n = ibf_char(pos, &w);
+			for (k = 0; k < n; k++)
+				c[k] = a_gapbuf_at(&A_IGB, pos + k);
+			if (hl)
+				frame_sethl(fr, a_highlight_at(&A_IHL, i, off, &hint));
+			if (!frame_put(fr, c, n, w))
+				return;
+			if (*c == '\n') { /* next line */
+				i++;
+				off = hint = 0;
+			} else {
+				off += n;
+			}
+		}
+		frame_sethl(fr, A_HL_NONE);
+	}
+	frame_eol(fr);
+	if (A_TM.tm_reading && (id = suggestion()) != A_HIST_NONE)
+		frame_suggestion(fr, id);
+	if (A_TM.tm_reading && picker.active)
+		frame_picker(fr);
+	frame_full(fr);
+}
+
+/*
+ * Move terminal cursor to the frame 'row' and 'col'.
+ * Moving down is done with newlines, so the terminal
+ * scrolls if the frame continues below the last row.
+ * Column 0 means the column is unknown (pending wrap).
+ */
+ASHE_PRIVATE void dbf_push_moveto(a_uint32 row, a_uint32 col)
+{
+	if (row < A_TROW) {
+		dbf_push_moveup(A_TROW - row);
+	} else if (row > A_TROW) {
+		for (; A_TROW < row; A_TROW++)
+			dbf_pushlit("\r\n");
+		A_TCOL = 1;
+	}
+	A_TROW = row;
+	if (col != A_TCOL) {
+		if (col == 1)
+			dbf_pushc('\r');
+		else
+			dbf_push_movecol(col);
+		A_TCOL = col;
+	}
+}
+
+/* Start the frame (first change on the screen). */
+ASHE_PRIVATE inline void dbf_push_framestart(void)
+{
+	if (A_TM.tm_syncout > 0)
+		dbf_pushlit(a_csi_sync_begin);
+	dbf_pushlit(a_csi_cursor_hide);
+}
+
+/* End the frame started with 'dbf_push_framestart()'. */
+ASHE_PRIVATE inline void dbf_push_frameend(void)
+{
+	dbf_pushlit(a_csi_cursor_show);
+	if (A_TM.tm_syncout > 0)
+		dbf_pushlit(a_csi_sync_end);
+}
+
+/*
+ * Scroll the viewport to the row 'top' by scrolling the terminal
+ * screen, rows that are still visible move along with it and
+ * only the rows that scrolled in need to be drawn.
+ * Viewport must fill the whole screen and move less than a screen.
+ */
+ASHE_PRIVATE void scroll_viewport(a_uint32 top)
+{
+	struct a_row *rows;
+	a_uint32 i, n, len;
+
+	rows = a_arr_ptr(A_TSFR.fr_rows);
+	len = a_arr_len(A_TSFR.fr_rows);
+	if (top > A_TVTOP) { /* newlines at the bottom row */
+		n = top - A_TVTOP;
+		dbf_push_moveto(A_TVTOP + len - 1, 1);
+		for (i = 0; i < n; i++)
+			dbf_pushlit("\r\n");
+		memmove(rows, rows + n, (len - n) * sizeof(*rows));
+		a_arr_len(A_TSFR.fr_rows) = len - n;
+		A_TROW = top + len - 1;
+	} else { /* reverse index at the top row */
+		n = A_TVTOP - top;
+		dbf_push_moveto(A_TVTOP, 1);
+		for (i = 0; i < n; i++)
+			dbf_pushlit(a_esc_reverse_index);
+		memmove(rows + n, rows, (len - n) * sizeof(*rows));
+		for (i = 0; i < n; i++)
+			rows[i] = (struct a_row){ .off = 0, .len = 0 };
+		A_TROW = top;
+	}
+	A_TVTOP = top;
+}
+
+/*
+ * Start of the terminal cell (character and the combining
+ * characters that follow it) that holds the byte 'p' of the
+ * row text 's' ('len' bytes).
+ */
+ASHE_PRIVATE a_uint32 cell_start(const char *s, a_uint32 len, a_uint32 p)
+{
+	a_uint32 w;
+
+	while (p > 0 && p < len) {
+		if (!a_utf8_iscont(s[p])) {
+			text_char(s + p, len - p, &w);
+			if (w > 0)
+				break;
+		}
+		p--;
+	}
+	return p;
+}
+
+/*
+ * Render the prompt and input.
+ * New frame is laid out and compared with the shadow frame
+ * (what is on the screen) row by row, only the changed part of
+ * each row is drawn (common prefix and, if row width did not
+ * change, common suffix are skipped, both end on cell boundaries),
+ * rows with escape sequences (prompt) are drawn whole, rows that
+ * are left over are cleared, then the cursor is moved to the
+ * cursor model.
+ * Only the viewport gets rendered, it follows the cursor and
+ * stays filled if the input is taller than the terminal.
+ */
+ASHE_PRIVATE void render(void)
+{
+	struct a_frame temp;
+	struct a_row *new, *old;
+	const char *ntext, *otext;
+	a_uint32 i, p, pcol, end, oend, olen, owidth, nrows, orows, row, col, total, top;
+	a_ubyte dirty;
+
+	if (A_TM.tm_reading) {
+		cursor_model(A_IROW, A_ICOL, &row, &col);
+		total = input_endrow() + 1 + picker_rows();
+	} else {
+		cursor_model(0, 0, &row, &col); /* end of prompt */
+		total = row + 1;
+	}
+
+	dirty = 0;
+	top = A_TVTOP;
+	if (top + A_TROWMAX > total)
+		top = (total > A_TROWMAX ? total - A_TROWMAX : 0);
+	if (row < top)
+		top = row;
+	else if (row >= top + A_TROWMAX)
+		top = row - A_TROWMAX + 1;
+	if (top != A_TVTOP) {
+		dbf_push_framestart();
+		dirty = 1;
+		if (a_arr_len(A_TSFR.fr_rows) == A_TROWMAX &&
+		    (top > A_TVTOP ? top - A_TVTOP : A_TVTOP - top) < A_TROWMAX) {
+			scroll_viewport(top);
+		} else { /* redraw the viewport over the rows on the screen */
+			A_TROW = A_TROW - A_TVTOP + top;
+			A_TVTOP = top;
+		}
+	}
+	layout(&A_TFR);
+
+	nrows = a_arr_len(A_TFR.fr_rows);
+	orows = a_arr_len(A_TSFR.fr_rows);
+	for (i = 0; i < nrows; i++) {
+		new = a_arr_row_index(&A_TFR.fr_rows, i);
+		ntext = a_arr_char_index(&A_TFR.fr_text, new->off);
+		olen = owidth = 0;
+		otext = NULL;
+		if (i < orows) {
+			old = a_arr_row_index(&A_TSFR.fr_rows, i);
+			otext = a_arr_char_index(&A_TSFR.fr_text, old->off);
+			olen = old->len;
+			owidth = old->width;
+		}
+		for (p = 0; p < new->len && p < olen && ntext[p] == otext[p]; p++);
+		if (p == new->len && p == olen) /* unchanged ? */
+			continue;
+		end = new->len;
+		if (a_unlikely(memchr(ntext, ESCAPE, new->len) ||
+			       (olen > 0 && memchr(otext, ESCAPE, olen)))) {
+			p = pcol = 0;
+		} else {
+			p = cell_start(otext, olen, cell_start(ntext, new->len, p));
+			pcol = (new->width == new->len ? p : text_width(ntext, p));
+			if (owidth == new->width) {
+				for (oend = olen; end > p && oend > p &&
+						  ntext[end - 1] == otext[oend - 1];
+				     end--, oend--);
+				while (end < new->len && end > cell_start(ntext, new->len, end))
+					end++;
+			}
+		}
+		if (!dirty) {
+			dbf_push_framestart();
+			dirty = 1;
+		}
+		dbf_push_moveto(A_TVTOP + i, pcol + 1);
+		dbf_push_len(ntext + p, end - p);
+		pcol += (end == new->len ? new->width - pcol : text_width(ntext + p, end - p));
+		A_TCOL = (pcol == A_TCOLMAX ? 0 : pcol + 1);
+		if (new->width < owidth)
+			dbf_pushlit(a_csi_clear_line_right);
+	}
+	if (orows > nrows) {
+		if (!dirty) {
+			dbf_push_framestart();
+			dirty = 1;
+		}
+		dbf_push_moveto(A_TVTOP + nrows, 1);
+		dbf_pushlit(a_csi_clear_down);
+	}
+	dbf_push_moveto(row, col);
+	if (dirty)
+		dbf_push_frameend();
+
+	temp = A_TSFR;
+	A_TSFR = A_TFR;
+	A_TFR = temp;
+}
+
+/*
+ * Forget the shadow frame, screen is blank from the
+ * cursor on and cursor is in the first column of the
+ * row where the prompt starts.
+ */
+ASHE_PRIVATE void shadow_reset(void)
+{
+	frame_clear(&A_TSFR);
+	A_TROW = 0;
+	A_TCOL = 1;
+	A_TVTOP = 0;
+}
+
+ASHE_PUBLIC a_uint32 ashe_insert_str(const char *s, a_uint32 len)
+{
+	if (a_unlikely(a_gapbuf_len(&A_IGB) + len > MAXCMDSIZE))
+		len = MAXCMDSIZE - a_gapbuf_len(&A_IGB);
+	if (len == 0)
+		return 0;
+
+	/* update input buffer and lines from the current one */
+	a_gapbuf_insert(&A_IGB, A_IBFIDX, s, len);
+	A_IBFIDX += len;
+	rebuild_lines(A_IROW);
+	render();
+	return len;
+}
+
+/*
+ * Insert the contents of the last bracketed paste.
+ * Carriage returns become newlines, tabs become spaces,
+ * the rest of control characters and bytes that are not
+ * valid UTF-8 are dropped.
+ */
+ASHE_PRIVATE void insert_paste(void)
+{
+	char *start, *end, *s, *p;
+	a_uint32 n, cp;
+	a_ubyte c;
+
+	start = a_arr_ptr(A_TKBF.kb_paste);
+	end = start + a_arr_len(A_TKBF.kb_paste);
+	for (s = p = start; s < end; s++) {
+		c = *s;
+		if (c >= 0x80) { /* multibyte character */
+			n = a_utf8_decode(s, end - s, &cp);
+			if (n > 1 && cp >= 0xA0) /* valid and not C1 control */
+				memmove(p, s, n), p += n;
+			s += n - 1;
+			continue;
+		} else if (c == '\r') {
+			if (s + 1 < end && s[1] == '\n')
+				continue;
+			c = '\n';
+		} else if (c == '\t') {
+			c = ' ';
+		} else if (c != '\n' && !(isgraph(c) || c == ' ')) {
+			continue;
+		}
+		*p++ = c;
+	}
+	ashe_insert_str(start, p - start);
+}
+
+/* characters that end the word being completed */
+#define iscomplsep(c) \
+	(isspace((a_ubyte)(c)) || (c) == ';' || (c) == '|' || (c) == '&' || (c) == '(' || (c) == ')' || \
+	 (c) == '<' || (c) == '>')
+
+/* characters that have to be inside of '"' */
+#define needsquote(c) (iscomplsep(c) || (c) == '"' || (c) == '\\' || (c) == '$')
+
+/* set if the completion waits for a directory listing */
+static a_ubyte complpending;
+
+/*
+ * Length in bytes of the character at 's' ('len' bytes available)
+ * of a completion candidate, its code point is stored in 'cp'. Control
+ * characters and invalid bytes are shown as '?' (like 'ls -q' does),
+ * names of files can have anything in them.
+ */
+ASHE_PRIVATE a_uint32 cand_char(const char *s, a_uint32 len, a_uint32 *cp)
+{
+	a_uint32 n;
+
+	n = a_utf8_decode(s, len, cp);
+	if (*cp < 0x20 || (*cp >= 0x7f && *cp < 0xa0) || (n == 1 && (a_ubyte)*s >= 0x80))
+		*cp = '?';
+	return n;
+}
+
+/* Display width of the completion candidate 'name'. */
+ASHE_PRIVATE a_uint32 cand_width(const char *name)
+{
+	a_uint32 i, n, cp, len, width;
+
+	len = strlen(name);
+	for (i = width = 0; i < len; i += n, width += a_utf8_width(cp))
+		n = cand_char(name + i, len - i, &cp);
+	return width;
+}
+
+/* Push the completion candidate 'name' (see 'cand_char()'). */
+ASHE_PRIVATE void cand_push(const char *name)
+{
+	a_uint32 i, n, cp, len;
+
+	len = strlen(name);
+	for (i = 0; i < len; i += n) {
+		n = cand_char(name + i, len - i, &cp);
+		if (cp == '?')
+			dbf_pushc('?');
+		else
+			dbf_push_len(name + i, n);
+	}
+}
+
+/*
+ * List the completion candidates 'm' in columns below
+ * the input, then draw the prompt and input again.
+ */
+ASHE_PRIVATE void list_completions(const a_arr_ccharp *m)
+{
+	a_uint32 i, j, k, w, maxw, cols, rows, shown;
+	a_uint32 col, row, idx;
+	const char *name;
+
+	shown = a_min(a_arrp_len(m), ASHE_COMPL_MAXLIST);
+	for (i = maxw = 0; i < shown; i++) {
+		w = cand_width(*a_arr_ccharp_index(m, i));
+		maxw = a_max(maxw, w);
+	}
+	cols = a_max(A_TCOLMAX / (maxw + 2), 1);
+	rows = (shown + cols - 1) / cols;
+
+	col = A_ICOL;
+	row = A_IROW;
+	idx = A_IBFIDX;
+	ashe_move_to_end();
+	dbf_pushlit("\r\n");
+	for (i = 0; i < rows; i++) { /* column major, like 'ls' */
+		for (j = 0; j < cols && (k = j * rows + i) < shown; j++) {
+			name = *a_arr_ccharp_index(m, k);
+			cand_push(name);
+			if (k + rows < shown)
+				for (w = cand_width(name); w < maxw + 2; w++)
+					dbf_pushc(' ');
+		}
+		dbf_pushlit("\r\n");
+	}
+	if (shown < a_arrp_len(m))
+		a_arr_char_push_strf(&A_TDBF, "... and %n more\r\n",
+				     (a_ssize)(a_arrp_len(m) - shown));
+	ashe_draw_prompt_unsafe();
+	A_ICOL = col;
+	A_IROW = row;
+	A_IBFIDX = idx;
+	render();
+	a_term_flush();
+#ifdef ASHE_DBG_CURSOR
+	a_term_resync_cursor(); /* new anchor for 'a_term_check_cursor()' */
+#endif
+}
+
+/*
+ * Complete the word that starts at 'start' and ends at the cursor
+ * ('len' bytes of it get completed) with the sorted candidates 'm'.
+ * Inserts the part common to all of them, if there is only one it
+ * also ends the word (unless it is a directory). Lists them if
+ * nothing can be inserted. 'dq' is set if the word is inside of
+ * '"', it gets quoted if the inserted part needs it.
+ */
+ASHE_PRIVATE void insert_completion(const a_arr_ccharp *m, a_uint32 start, a_uint32 len,
+				    a_ubyte dq)
+{
+	a_uint32 n, i, common, idx;
+	const char *a, *b;
+
+	if ((n = a_arrp_len(m)) == 0)
+		return;
+	a = *a_arr_ccharp_index(m, 0);
+	b = *a_arr_ccharp_index(m, n - 1);
+	for (common = len; a[common] && a[common] == b[common]; common++);
+	if (common == len && n > 1) {
+		list_completions(m);
+		return;
+	}
+	for (i = len; !dq && i < common; i++) {
+		if (needsquote(a[i])) {
+			idx = A_IBFIDX;
+			set_cursor(start);
+			ashe_insert_str("\"", 1);
+			set_cursor(idx + 1);
+			dq = 1;
+		}
+	}
+	ashe_insert_str(a + len, common - len);
+	if (n == 1 && a[common - 1] != '/') {
+		if (dq)
+			ashe_insert_str("\"", 1);
+		ashe_insert_str(" ", 1);
+	}
+}
+
+/*
+ * Complete the path 'word' ('len' bytes long), its directory
+ * part may start with a variable ('$HOME/...').
+ */
+ASHE_PRIVATE void complete_path(a_uint32 start, const char *word, a_uint32 len, a_ubyte dq)
+{
+	const char *base, *p, *value;
+	a_arr_char dir;
+	a_uint32 n;
+	a_int32 res;
+
+	for (base = word + len; base > word && base[-1] != '/'; base--);
+	a_arr_char_init(&dir);
+	p = word;
+	if (*p == '$' && base > word) {
+		n = strspn(p + 1, ENV_VAR_CHARS);
+		a_arr_char_push_str(&dir, p + 1, n);
+		a_arr_char_push(&dir, '\0');
+		value = getenv(a_arr_ptr(dir));
+		a_arr_len(dir) = 0;
+		if (!value)
+			goto out;
+		a_arr_char_push_str(&dir, value, strlen(value));
+		p += n + 1;
+	}
+	if (memchr(p, '$', base - p))
+		goto out;
+	a_arr_char_push_str(&dir, p, base - p);
+	if (a_arr_len(dir) == 0)
+		a_arr_char_push(&dir, '.');
+	a_arr_char_push(&dir, '\0');
+
+	n = word + len - base;
+	if ((res = ashe_pathcompl_find(a_arr_ptr(dir), base, n, ASHE_COMPL_DEADLINE_MS)) < 0)
+		complpending = 1; /* 'complete()' again once it loads */
+	else if (res > 0)
+		insert_completion(ashe_pathcompl_matches(), start, n, dq);
+out:
+	a_arr_char_free(&dir, NULL);
+}
+
+/*
+ * Complete the word before the cursor, first word of a command
+ * is completed from the command names (unless it has '/' in it),
+ * the rest of them as paths.
+ * Words with escapes do not get completed, words inside of '"'
+ * do if the quote starts them.
+ */
+ASHE_PRIVATE void complete(void)
+{
+	struct a_cmdindex *ci = &ashe.sh_cmdindex;
+	a_uint32 start, idx, len;
+	const char *ibf, *word;
+	a_ubyte dq;
+
+	complpending = 0;
+	ibf = a_gapbuf_prefix(&A_IGB, A_IBFIDX);
+	if ((dq = ashe_indq(ibf, A_IBFIDX)))
+		for (start = A_IBFIDX; ibf[start - 1] != '"'; start--);
+	else
+		for (start = A_IBFIDX; start > 0 && !iscomplsep(ibf[start - 1]); start--);
+	word = ibf + start;
+	len = A_IBFIDX - start;
+	if (memchr(word, '\\', len) || memchr(word, '"', len))
+		return;
+
+	for (idx = start - dq; idx > 0 && isblank((a_ubyte)ibf[idx - 1]); idx--);
+	if ((idx == 0 || strchr(";|&(\n", ibf[idx - 1])) && !memchr(word, '/', len)) {
+		if (!dq && !memchr(word, '$', len) && a_cmdindex_find(ci, word, len) > 0)
+			insert_completion(&ci->ci_matches, start, len, 0);
+	} else {
+		complete_path(start, word, len, dq);
+	}
+}
+
+/* Directory listing loaded, finish the completion waiting for it. */
+ASHE_PRIVATE void complete_loaded(void)
+{
+	if (ashe_pathcompl_collect() && complpending) {
+		complete();
+		a_term_flush();
+	}
+}
+
+/* Clear input buffer and lines. */
+ASHE_PRIVATE void clear_ibf(void)
+{
+	a_gapbuf_clear(&A_IGB);
+	a_arr_len(A_ILINES) = 0;
+	a_arr_line_push(&A_ILINES, (struct a_line){ .len = 0, .width = 0 });
+	sync_lines_from(0);
+	a_highlight_edit(&A_IHL, 0, A_HL_ALL, 0);
+	A_IBFIDX = 0;
+	A_IROW = 0;
+	A_ICOL = 0;
+}
+
+ASHE_PUBLIC void ashe_clearinput(void)
+{
+	clear_ibf();
+	render();
+}
+
+ASHE_PUBLIC void ashe_deletefront(void)
+{
+	ashe_remove_bytes(-1);
+}
+
+ASHE_PUBLIC void ashe_deleteback(void)
+{
+	if (A_IBFIDX == 0)
+		return;
+	remove_range(0, A_IBFIDX);
+	render();
+}
+
+ASHE_PRIVATE void setinput2history(void)
+{
+	struct a_histlist *hl;
+
+	hl = &ashe.sh_history;
+	if (hl->current != A_HIST_NONE) {
+		clear_ibf();
+		ashe_insert_str(ashe_histtext(hl, hl->current), ashe_histlen(hl, hl->current));
+	} else {
+		ashe_clearinput();
+	}
+}
+
+/* Replace the input with 's' ('len' bytes long), cursor at 'idx'. */
+ASHE_PRIVATE void replace_ibf(const char *s, a_uint32 len, a_uint32 idx)
 {
-	a_arr_char_init_cap(&A_IBF, 8);
-	A_IBFIDX = 0;
-	/* input lines */
-	a_arr_line_init(&A_ILINES);
-	a_arr_line_push(&A_ILINES, (struct a_line){ .len = 0, .start = a_arr_ptr(A_IBF) });
-	A_ICOL = 0;
-	A_IROW = 0;
-	/* rest is set dynamically */
+	if (a_unlikely(len > MAXCMDSIZE))
+		len = MAXCMDSIZE;
+	clear_ibf();
+	a_gapbuf_insert(&A_IGB, 0, s, len);
+	rebuild_lines(0);
+	set_cursor(idx < len ? idx : len);
 }
 
-ASHE_PRIVATE void a_input_free(void)
+/* Build the search prompt into the prompt buffer. */
+ASHE_PRIVATE void search_prompt(void)
 {
-	a_arr_char_free(&A_IBF, NULL);
-	a_arr_line_free(&A_ILINES, NULL);
+	static const char intro[] = "(reverse-i-search)`";
+	static const char failed[] = "(failed reverse-i-search)`";
+
+	if (hsearch.failed)
+		a_arr_char_push_str(&A_TP, failed, SS(failed));
+	else
+		a_arr_char_push_str(&A_TP, intro, SS(intro));
+	a_arr_char_push_str(&A_TP, a_arr_ptr(hsearch.query), a_arr_len(hsearch.query));
+	a_arr_char_push_str(&A_TP, "': ", SS("': "));
+	a_arr_char_push(&A_TP, '\0');
 }
 
 /*
- * Re-links the slices (lines) to the input buffer.
- * This should be called after inserting bytes into
- * the input buffer because buffer might reallocate
- * to a different memory address.
+ * Show the newest command older than 'before' that contains the
+ * query, commands with the same text as the shown one get skipped.
+ * If there is no such command the last match stays in the input.
  */
-ASHE_PRIVATE void relink_lines(void)
+ASHE_PRIVATE void search_from(a_uint32 before)
 {
-	struct a_line *prev;
-	struct a_line *curr;
-	a_uint32 i, lines;
+	struct a_histlist *hl;
+	a_uint32 id, len, pos;
+
+	hl = &ashe.sh_history;
+	len = a_arr_len(hsearch.query);
+	hsearch.failed = 0;
+	if (len > 0) {
+		id = before;
+		do {
+			id = ashe_histsearch(hl, a_arr_ptr(hsearch.query), len, id, &pos);
+		} while (id != A_HIST_NONE && hsearch.match != A_HIST_NONE && id != hsearch.match &&
+			 ashe_histlen(hl, id) == ashe_histlen(hl, hsearch.match) &&
+			 memcmp(ashe_histtext(hl, id), ashe_histtext(hl, hsearch.match),
+				ashe_histlen(hl, id)) == 0);
+		if (id != A_HIST_NONE) {
+			hsearch.match = id;
+			replace_ibf(ashe_histtext(hl, id), ashe_histlen(hl, id), pos);
+		} else {
+			hsearch.failed = 1;
+		}
+	}
+	expand_prompt();
+	render();
+}
 
-	lines = a_arr_len(A_ILINES);
-	prev = a_arr_line_index(&A_ILINES, 0);
-	prev->start = a_arr_ptr(A_IBF);
+/* Search again from the shown match (inclusive) after the query changed. */
+#define search_again() \
+	search_from(hsearch.match != A_HIST_NONE ? hsearch.match + 1 : A_HIST_NONE)
 
-	for (i = 1; i < lines; i++) {
-		curr = a_arr_line_index(&A_ILINES, i);
-		curr->start = prev->start + prev->len;
-		prev = curr;
-	}
+ASHE_PRIVATE void search_start(void)
+{
+	hsearch.active = 1;
+	hsearch.failed = 0;
+	hsearch.match = A_HIST_NONE;
+	a_arr_len(hsearch.query) = 0;
+	a_arr_len(hsearch.saved) = 0;
+	a_gapbuf_copy(&A_IGB, 0, a_gapbuf_len(&A_IGB), &hsearch.saved);
+	hsearch.savedidx = A_IBFIDX;
+	expand_prompt();
+	render();
 }
 
-/* Redraw prompt, do not update cursor. */
-ASHE_PUBLIC void ashe_redraw_prompt_unsafe(void)
+ASHE_PRIVATE void search_end(void)
 {
-	dbf_pushlit(a_csi_cursor_hide);
-	dbf_push_len(a_arr_ptr(A_TP), A_TPLEN);
-	dbf_pushlit(a_csi_cursor_show);
-	dbf_flush();
+	hsearch.active = 0;
+	hsearch.match = A_HIST_NONE;
+	expand_prompt();
+	render();
 }
 
 /*
- * Return number of rows between the current row
- * and the first row where the prompt resides
- * if the 'prompt' is non zero value.
- * Otherwise return the number of rows between the
- * current row and the first terminal row where the
- * input buffer begins.
+ * Handle the key 'c' while searching, returns 0 if the key
+ * accepted the match and should be processed as usual.
  */
-ASHE_PRIVATE a_uint32 first_row_diff(a_ubyte prompt)
+ASHE_PRIVATE a_ubyte search_key(a_int32 c)
 {
-	struct a_line *line;
-	a_ssize temp;
-	a_uint32 idx, rows;
-
-	prompt = (prompt != 0);
-	idx = A_IROW;
-	line = &A_ILINE;
-	temp = line->len;
-
-	for (rows = 0; 0 < idx; idx--) {
-		rows += trowdiffx(temp - 1) + 1;
-		line = a_arr_line_index(&A_ILINES, idx);
-		temp = line->len;
+	switch (c) {
+	case CTRL_KEY('r'):
+		if (hsearch.match != A_HIST_NONE)
+			search_from(hsearch.match);
+		return 1;
+	case CTRL_KEY('g'):
+		replace_ibf(a_arr_ptr(hsearch.saved), a_arr_len(hsearch.saved), hsearch.savedidx);
+		search_end();
+		return 1;
+	case DEL_KEY:
+	case BACKSPACE:
+		while (a_arr_len(hsearch.query) > 0 &&
+		       (*a_arr_char_last(&hsearch.query) & 0xC0) == 0x80)
+			a_arr_len(hsearch.query)--; /* continuation bytes */
+		if (a_arr_len(hsearch.query) > 0)
+			a_arr_len(hsearch.query)--;
+		search_again();
+		return 1;
+	case UTF8_KEY:
+		a_arr_char_push_str(&hsearch.query, A_TKBF.kb_char, A_TKBF.kb_charlen);
+		search_again();
+		return 1;
+	default: /* 'enum termkey' values are out of the <ctype.h> range */
+		if ((c >= 0 && c <= 0xff && isgraph(c)) || c == ' ') {
+			a_arr_char_push(&hsearch.query, c);
+			search_again();
+			return 1;
+		}
+		break;
 	}
+	if (hsearch.match != A_HIST_NONE) /* 'Ctrl+p' and 'Ctrl+n' continue from the match */
+		ashe.sh_history.current = hsearch.match;
+	search_end();
+	return 0;
+}
 
-	rows += trowdiffx(temp - 1 + (prompt * A_TPLEN));
-
-	return rows;
+/* Build the fuzzy finder prompt into the prompt buffer. */
+ASHE_PRIVATE void picker_prompt(void)
+{
+	a_arr_char_push_strf(&A_TP, "(fuzzy %n/%n%s): ", (a_ssize)picker.res.nmatched,
+			     (a_ssize)picker.res.ncands, (picker.res.done ? "" : "..."));
+	a_arr_char_push(&A_TP, '\0');
 }
 
 /*
- * Return number of rows between the current row
- * and the last input buffer row.
+ * Start the fuzzy finder over the history and the paths under
+ * the cwd, the input becomes the query until it ends.
  */
-ASHE_PRIVATE a_uint32 last_row_diff(void)
+ASHE_PRIVATE void picker_start(void)
 {
-	a_ssize temp;
-	a_uint32 idx, rows, lines, extra;
-
-	lines = a_arr_len(A_ILINES);
-	idx = A_IROW;
-	extra = (idx == 0) * A_TPLEN;
-	temp = a_arr_line_index(&A_ILINES, idx)->len;
-	temp += extra;
-	temp -= trowdiffx(A_ICOL + extra);
+	if (!ashe_fuzzy_start(&ashe.sh_history))
+		return;
+	picker.active = 1;
+	picker.sel = 0;
+	picker.res = (struct a_fzresults){ 0 };
+	a_arr_len(picker.query) = 0;
+	a_arr_len(picker.saved) = 0;
+	a_gapbuf_copy(&A_IGB, 0, a_gapbuf_len(&A_IGB), &picker.saved);
+	picker.savedidx = A_IBFIDX;
+	replace_ibf("", 0, 0);
+	ashe_fuzzy_query("", 0);
+	expand_prompt();
+	render();
+}
 
-	for (rows = 0; idx < lines; idx++) {
-		rows += trowdiffx(temp - 1) + 1;
-		temp = a_arr_line_index(&A_ILINES, idx)->len;
+/*
+ * End the fuzzy finder and restore the input, if 'accept' is
+ * set the selected history entry replaces it or the selected
+ * path gets inserted at the cursor (quoted if it needs to be).
+ */
+ASHE_PRIVATE void picker_end(a_ubyte accept)
+{
+	const char *s;
+	a_uint32 i, len;
+	a_ubyte ishist;
+
+	picker.active = 0;
+	replace_ibf(a_arr_ptr(picker.saved), a_arr_len(picker.saved), picker.savedidx);
+	if (accept && picker.sel < picker.res.nmatches) {
+		s = ashe_fuzzy_candidate(picker.res.matches[picker.sel].idx, &len, &ishist);
+		if (ishist) {
+			replace_ibf(s, len, len);
+		} else {
+			for (i = 0; i < len && !needsquote(s[i]); i++);
+			if (i < len)
+				ashe_insert_str("\"", 1);
+			ashe_insert_str(s, len);
+			if (i < len)
+				ashe_insert_str("\"", 1);
+		}
 	}
-	if (idx != 0)
-		rows--; /* we overshoot by one row always */
-
-	return rows;
+	ashe_fuzzy_stop();
+	expand_prompt();
+	render();
 }
 
-ASHE_PUBLIC void ashe_clearinput(void)
+/* Match the candidates again if the query (input) changed. */
+ASHE_PRIVATE void picker_sync(void)
 {
-	ashe_move_to_start();
-	a_arr_len(A_IBF) = 0;
-	a_arr_line_free(&A_ILINES, NULL);
-	a_arr_line_init(&A_ILINES);
-	a_arr_line_push(&A_ILINES, (struct a_line){.len = 0, .start = a_arr_ptr(A_IBF)});
-	draw_lit(a_csi_cursor_hide a_csi_clear_line_right a_csi_clear_down a_csi_cursor_show);
+	const char *query;
+	a_uint32 len;
+
+	len = a_gapbuf_len(&A_IGB);
+	query = a_gapbuf_prefix(&A_IGB, len);
+	if (len == a_arr_len(picker.query) &&
+	    (len == 0 || memcmp(query, a_arr_ptr(picker.query), len) == 0))
+		return;
+	a_arr_len(picker.query) = 0;
+	a_arr_char_push_str(&picker.query, query, len);
+	picker.sel = 0;
+	ashe_fuzzy_query(query, len);
 }
 
-ASHE_PUBLIC void ashe_deletefront(void)
+/* New fuzzy finder results are available, list them. */
+ASHE_PRIVATE void picker_update(void)
 {
-	a_uint32 idx;
+	if (ashe_fuzzy_collect(&picker.res) && picker.active) {
+		if (picker.sel >= picker.res.nmatches)
+			picker.sel = (picker.res.nmatches > 0 ? picker.res.nmatches - 1 : 0);
+		expand_prompt();
+		render();
+		a_term_flush();
+	}
+}
 
-	idx = A_IBFIDX;
-	while (ashe_move_right());
-	while (A_IBFIDX > idx)
-		ashe_remove_char();
+/*
+ * Handle the key 'c' while the fuzzy finder is active, returns 0
+ * if the key should be processed as usual. Keys that edit the
+ * input edit the query, the rest of them end the fuzzy finder.
+ */
+ASHE_PRIVATE a_ubyte picker_key(a_int32 c)
+{
+	switch (c) {
+	case D_ARW:
+	case CTRL_KEY('j'):
+	case CTRL_KEY('n'):
+		if (picker.sel + 1 < picker.res.nmatches)
+			picker.sel++;
+		break;
+	case U_ARW:
+	case CTRL_KEY('k'):
+	case CTRL_KEY('p'):
+		if (picker.sel > 0)
+			picker.sel--;
+		break;
+	case CR:
+	case CTRL_KEY('i'):
+		picker_end(1);
+		return 1;
+	case ESCAPE:
+	case CTRL_KEY('g'):
+	case CTRL_KEY('t'):
+		picker_end(0);
+		return 1;
+	case DEL_KEY:
+	case BACKSPACE:
+	case L_ARW:
+	case R_ARW:
+	case HOME_KEY:
+	case END_KEY:
+	case CTRL_KEY('e'):
+	case CTRL_KEY('s'):
+	case CTRL_KEY('h'):
+	case CTRL_KEY('l'):
+	case CTRL_KEY('w'):
+	case CTRL_KEY('d'):
+	case CTRL_KEY('f'):
+	case CTRL_KEY('b'):
+	case PASTE_KEY:
+	case UTF8_KEY:
+		return 0;
+	default:
+		if (!(c >= 0 && c <= 0xff && isgraph(c)) && c != ' ')
+			picker_end(0);
+		return 0;
+	}
+	render();
+	return 1;
 }
 
-ASHE_PRIVATE void setinput2history(void)
+/*
+ * Read bracketed paste contents into the paste buffer,
+ * up to the paste end sequence.
+ */
+ASHE_PRIVATE void read_paste(void)
 {
-	struct a_histnode *hist;
-	a_int32 i;
-
-	ashe_clearinput();
-	hist = ashe.sh_history.current;
-	/* This code is very very very slow, but I
-	 * am very very very lazy. */
-	if (hist) {
-		draw_lit(a_csi_cursor_hide);
-		for (i = 0; i < hist->len; i++)
-			ashe_insert_char(hist->contents[i], 0);
-		draw_lit(a_csi_cursor_show);
+	static const char pasteend[] = A_ESC(201~);
+	a_arr_char *paste;
+	a_uint32 n;
+	a_int32 c;
+
+	paste = &A_TKBF.kb_paste;
+	a_arrp_len(paste) = 0;
+	n = 0; /* bytes of 'pasteend' matched */
+	while ((c = kbf_getc(ASHE_PASTE_TIMEOUT_MS)) >= 0) {
+		n = (c == pasteend[n]) ? n + 1 : (c == ESCAPE);
+		if (a_likely(a_arrp_len(paste) < MAXCMDSIZE || n > 0))
+			a_arr_char_push(paste, c);
+		if (n == SS(pasteend)) {
+			a_arrp_len(paste) -= n;
+			break;
+		}
 	}
 }
 
-ASHE_PRIVATE enum termkey read_key(void)
+/* Decode the rest of the control sequence (after 'A_CSI'). */
+ASHE_PRIVATE a_int32 read_csi(void)
 {
-	a_ubyte seq[3];
-	a_int32 nread;
-	a_byte c;
+	a_uint32 param;
+	a_ubyte sep;
+	a_int32 c;
 
-	ashe_mask_signals(SIG_UNBLOCK);
-	while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-		if (a_unlikely(nread == -1 && (errno != EINTR && !ashe.sh_int)))
-			ashe_panic_libcall(read);
-		ashe.sh_int = 0;
+	param = sep = 0;
+	for (;;) { /* parameter and intermediate bytes */
+		if ((c = kbf_getc(ASHE_ESC_TIMEOUT_MS)) < 0)
+			return ESCAPE; /* incomplete */
+		if (c >= 0x40 && c <= 0x7E) /* final byte */
+			break;
+		if (a_unlikely(c < 0x20 || c > 0x3F))
+			return ESCAPE; /* malformed */
+		if (c == ';') sep = 1;
+		else if (!sep && isdigit(c)) param = param * 10 + (c - '0');
 	}
-	ashe_mask_signals(SIG_BLOCK);
 
-	if (c == ESCAPE) {
-		if (read(STDIN_FILENO, &seq[0], 1) != 1)
-			return ESCAPE;
-		if (read(STDIN_FILENO, &seq[1], 1) != 1)
+	switch (c) {
+	case 'A':
+		return U_ARW;
+	case 'B':
+		return D_ARW;
+	case 'C':
+		return R_ARW;
+	case 'D':
+		return L_ARW;
+	case 'H':
+		return HOME_KEY;
+	case 'F':
+		return END_KEY;
+	case '~':
+		switch (param) {
+		case 1:
+		case 7:
+			return HOME_KEY;
+		case 4:
+		case 8:
+			return END_KEY;
+		case 3:
+			return DEL_KEY;
+		case 200:
+			read_paste();
+			return PASTE_KEY;
+		default:
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+	return ESCAPE;
+}
+
+/*
+ * Decode the rest of the UTF-8 character that starts with the
+ * byte 'c' into 'kb_char', malformed character is dropped
+ * (byte that can't continue it is left in the key buffer).
+ */
+ASHE_PRIVATE a_int32 read_utf8(a_int32 c)
+{
+	a_uint32 i, n, cp;
+
+	n = a_utf8_seqlen(c);
+	A_TKBF.kb_char[0] = c;
+	for (i = 1; i < n; i++) {
+		if ((c = kbf_getc(ASHE_ESC_TIMEOUT_MS)) < 0)
+			return ESCAPE; /* incomplete */
+		if (a_unlikely(!a_utf8_iscont(c))) {
+			A_TKBF.kb_pos--;
 			return ESCAPE;
-		if (seq[0] == '[') {
-			if (isdigit(seq[1])) {
-				if (read(STDIN_FILENO, &seq[2], 1) != 1)
-					return ESCAPE;
-				if (seq[2] == '~') {
-					switch (seq[1]) {
-					case '3':
-						return DEL_KEY;
-					case '1':
-					case '7':
-						return HOME_KEY;
-					case '4':
-					case '8':
-						return END_KEY;
-					default:
-						break;
-					}
-				}
-			} else {
-				switch (seq[1]) {
-				case 'C':
-					return R_ARW;
-				case 'D':
-					return L_ARW;
-				case 'B':
-					return D_ARW;
-				case 'A':
-					return U_ARW;
-				case 'H':
-					return HOME_KEY;
-				case 'F':
-					return END_KEY;
-				default:
-					break;
-				}
-			}
-		} else if (seq[0] == 'O') {
-			switch (seq[1]) {
-			case 'H':
-				return HOME_KEY;
-			case 'F':
-				return HOME_KEY;
-			default:
-				break;
-			}
 		}
+		A_TKBF.kb_char[i] = c;
+	}
+	if (a_unlikely(n == 1 || a_utf8_decode(A_TKBF.kb_char, n, &cp) != n || cp < 0xA0))
 		return ESCAPE;
-	} else {
-		return c;
+	A_TKBF.kb_charlen = n;
+	return UTF8_KEY;
+}
+
+/*
+ * Decode the next key from the key buffer.
+ * Escape sequences are decoded byte by byte, if the
+ * rest of the sequence does not arrive in time, the
+ * bytes read so far are dropped (lone escape).
+ */
+ASHE_PRIVATE a_int32 read_key(void)
+{
+	a_int32 c;
+
+	if ((c = kbf_getc(-1)) != ESCAPE)
+		return (c < 0x80 ? c : read_utf8(c));
+
+	switch (kbf_getc(ASHE_ESC_TIMEOUT_MS)) {
+	case '[':
+		return read_csi();
+	case 'O': /* SS3 */
+		switch (kbf_getc(ASHE_ESC_TIMEOUT_MS)) {
+		case 'A':
+			return U_ARW;
+		case 'B':
+			return D_ARW;
+		case 'C':
+			return R_ARW;
+		case 'D':
+			return L_ARW;
+		case 'H':
+			return HOME_KEY;
+		case 'F':
+			return END_KEY;
+		default:
+			break;
+		}
+		break;
+	default: /* lone escape or unsupported 'meta' key */
+		break;
 	}
+	return ESCAPE;
 }
 
 ASHE_PRIVATE a_ubyte process_key(void)
 {
 	a_int32 c;
 
-	if (IMPLEMENTED((c = read_key()))) {
+	c = read_key();
+	if (hsearch.active && search_key(c))
+		c = ESCAPE; /* consumed by the search */
+	else if (picker.active && picker_key(c))
+		c = ESCAPE; /* consumed by the fuzzy finder */
+	if (IMPLEMENTED(c)) {
+		if (c != CTRL_KEY('i'))
+			complpending = 0; /* input changed, drop the waiting completion */
 		switch (c) {
 		case CR:
 			if (ashe_cr()) break;
@@ -410,7 +2043,8 @@ ASHE_PRIVATE a_ubyte process_key(void)
 			break;
 		case R_ARW:
 		case CTRL_KEY('l'):
-			ashe_move_right();
+			if (!ashe_move_right())
+				accept_suggestion();
 			break;
 		case U_ARW:
 		case CTRL_KEY('k'):
@@ -429,28 +2063,47 @@ ASHE_PRIVATE a_ubyte process_key(void)
 				setinput2history();
 			break;
 		case CTRL_KEY('r'):
+			search_start();
+			break;
+		case CTRL_KEY('o'):
 			ashe_clear_screen_and_redraw();
 			break;
+		case CTRL_KEY('t'):
+			picker_start();
+			break;
 		case CTRL_KEY('w'):
-			while (ashe_remove_char());
+			ashe_deleteback();
 			break;
 		case CTRL_KEY('d'):
 			ashe_deletefront();
 			break;
-		// TODO: CTRL + f (move forward by a single word)
-		// TODO: CTRL + b (move back by a single word)
+		case CTRL_KEY('f'):
+			ashe_move_word_right();
+			break;
+		case CTRL_KEY('b'):
+			ashe_move_word_left();
+			break;
 		case CTRL_KEY('x'):
 			ashe_exit(EXIT_SUCCESS);
 			break;
 		case CTRL_KEY('i'):
-			// TODO: glob operator (same as TAB in other shells)
+			complete();
+			break;
+		case PASTE_KEY:
+			insert_paste();
+			break;
+		case UTF8_KEY:
+			ashe_insert_str(A_TKBF.kb_char, A_TKBF.kb_charlen);
 			break;
 		default:
 			if (isgraph(c) || c == ' ')
-				ashe_insert_char(c, 1);
+				ashe_insert_char(c);
 			break;
 		}
+		if (picker.active)
+			picker_sync();
 	}
+	a_term_flush(); /* single write per key event */
 #ifdef ASHE_DBG_CURSOR
 	debug_cursor();
 #endif
@@ -460,23 +2113,43 @@ ASHE_PRIVATE a_ubyte process_key(void)
 	return 1;
 }
 
+/* Move the cursor to the end of the input, drop the suggestion. */
+ASHE_PRIVATE void leave_input(void)
+{
+	suggesting = 0;
+	set_cursor(a_gapbuf_len(&A_IGB));
+	render();
+}
+
 ASHE_PRIVATE void a_input_read(void)
 {
-	a_term_sync_cursor(); /* sync once in raw mode */
+#ifdef ASHE_DBG_CURSOR
+	a_term_resync_cursor(); /* anchor for 'a_term_check_cursor()' */
+#else
+	a_term_sync_cursor();
+#endif
 #ifdef ASHE_DBG_CURSOR
 	debug_cursor();
 #endif
 #ifdef ASHE_DBG_LINES
 	debug_lines();
 #endif
+	suggesting = 1;
 	while (process_key());
+	a_gapbuf_copy(&A_IGB, 0, a_gapbuf_len(&A_IGB), &A_IBF);
 	a_arr_char_push(&A_IBF, '\0');
 	resethistcurrent();
-	while (ashe_move_right());
+	leave_input();
 }
 
 ASHE_PUBLIC void a_input_clear(void)
 {
+	hsearch.active = 0;
+	hsearch.match = A_HIST_NONE;
+	if (picker.active) {
+		picker.active = 0;
+		ashe_fuzzy_stop();
+	}
 	a_input_free();
 	a_input_init();
 }
@@ -484,8 +2157,25 @@ ASHE_PUBLIC void a_input_clear(void)
 ASHE_PUBLIC void a_term_init(void)
 {
 	a_arr_char_init_cap(&A_TP, sizeof(ASHE_PROMPT));
+	a_arr_char_push(&A_TP, '\0'); /* empty prompt until drawn */
+	A_TPCOLS = 0;
+	a_userstr_init(&A_TPT);
+	a_userstr_compile(&A_TPT, ASHE_PROMPT);
 	a_input_init();
 	a_arr_char_init_cap(&A_TDBF, 8);
+	A_TKBF.kb_buf = ashe_malloc(A_KBFSIZE);
+	A_TKBF.kb_cap = A_KBFSIZE;
+	A_TKBF.kb_pos = A_TKBF.kb_len = A_TKBF.kb_cooked = 0;
+	a_arr_char_init(&A_TKBF.kb_paste);
+	A_TKBF.kb_charlen = 0;
+	a_arr_char_init(&hsearch.query);
+	a_arr_char_init(&hsearch.saved);
+	a_arr_char_init(&A_TFR.fr_text);
+	a_arr_row_init(&A_TFR.fr_rows);
+	a_arr_char_init(&A_TSFR.fr_text);
+	a_arr_row_init(&A_TSFR.fr_rows);
+	A_TM.tm_syncout = -1;
+	A_TOS = (struct a_outstat){ 0 };
 	ashe_tcgetattr(&A_TIODFL); /* init default termios */
 	init_rawterm(&A_TIORAW); /* init raw mode */
 	a_term_sync_dimensions();
@@ -495,39 +2185,56 @@ ASHE_PUBLIC void a_term_init(void)
 
 ASHE_PUBLIC void a_term_read(void)
 {
-	ashe_mask_signals(SIG_BLOCK);
 	a_input_clear();
+	ashe_tcsetattr(TCSADRAIN, &A_TIORAW); /* keep the typeahead */
+	kbf_typeahead();
+	if (a_unlikely(A_TM.tm_syncout < 0))
+		query_syncout();
 	ashe_draw_prompt_unsafe();
 	A_TM.tm_reading = 1;
-	ashe_tcsetattr(TCSAFLUSH, &A_TIORAW);
+	dbf_pushlit(a_csi_paste_on);
+	a_term_flush();
+	a_cmdindex_warm(&ashe.sh_cmdindex); /* ahead of the first 'complete()' */
 	a_input_read();
-	ashe_tcsetattr(TCSAFLUSH, &A_TIODFL);
+	dbf_pushlit(a_csi_paste_off "\r\n");
+	a_term_flush();
+	ashe_tcsetattr(TCSADRAIN, &A_TIODFL);
 	A_TM.tm_reading = 0;
-	ashe_print("\n", stderr);
 }
 
 ASHE_PUBLIC void a_term_sync_cursor(void)
 {
-	char buf[ASHE_MAXINT16STR * 2 + sizeof(A_CSI ";")]; /* A_ESC [ Pn ; Pn R */
-	a_ssize nread;
-	a_uint32 srow, scol;
-	a_uint16 i;
-	char c;
+	cursor_model(A_IROW, A_ICOL, &A_TROW, &A_TCOL);
+}
 
-	i = 0;
-	draw_lit(a_csi_cursor_position);
-	while (i < sizeof(buf) && (nread = read(STDIN_FILENO, &c, 1)) == 1) {
-		if (c == 'R')
-			break;
-		buf[i++] = c;
-	}
+ASHE_PUBLIC void a_term_resync_cursor(void)
+{
+	a_uint32 row, col;
 
-	if (a_unlikely(sscanf(buf, "\033[%u;%u", &srow, &scol) != 2))
-		ashe_panic_libcall(sscanf);
+	query_cursor(&row, &col);
+	a_term_sync_cursor();
+	A_ISROW = row - A_TROW;
+	A_ISCOL = 1;
+}
 
-	A_TROW = srow;
-	A_TCOL = scol;
+#ifdef ASHE_DBG_CURSOR
+ASHE_PUBLIC a_ubyte a_term_check_cursor(a_uint32 *realrow, a_uint32 *realcol)
+{
+	a_uint32 endrow;
+
+	query_cursor(realrow, realcol);
+	/* viewport that fills the screen starts at the top row (start
+	 * row wraps around if the prompt is above the screen), otherwise
+	 * terminal scrolled if the end of the input (or the fuzzy finder
+	 * matches below it) got drawn below the last row, re-anchor */
+	endrow = input_endrow() + picker_rows();
+	if (endrow + 1 >= A_TVTOP + A_TROWMAX)
+		A_ISROW = 1 - A_TVTOP;
+	else if (A_ISROW + endrow > A_TROWMAX)
+		A_ISROW = A_TROWMAX - endrow;
+	return (*realrow == A_ISROW + A_TROW && *realcol == A_TCOL);
 }
+#endif
 
 ASHE_PUBLIC void a_term_sync_dimensions(void)
 {
@@ -535,163 +2242,101 @@ ASHE_PUBLIC void a_term_sync_dimensions(void)
 
 	if (a_unlikely(ioctl(STDIN_FILENO, TIOCGWINSZ, &ws) < 0 || ws.ws_col == 0)) {
 		get_winsize_fallback();
-		return;
+	} else {
+		A_TROWMAX = ws.ws_row;
+		A_TCOLMAX = ws.ws_col;
 	}
-	A_TROWMAX = ws.ws_row;
-	A_TCOLMAX = ws.ws_col;
+	sync_promptcols(); /* wide characters wrap early */
+	sync_lines_from(0); /* rows depend on the terminal width */
 }
 
 ASHE_PUBLIC void a_term_free(void)
 {
 	a_arr_char_free(&A_TP, NULL);
+	a_userstr_free(&A_TPT);
 	a_input_free();
 	a_arr_char_free(&A_TDBF, NULL);
+	ashe_free(A_TKBF.kb_buf);
+	a_arr_char_free(&A_TKBF.kb_paste, NULL);
+	a_arr_char_free(&hsearch.query, NULL);
+	a_arr_char_free(&hsearch.saved, NULL);
+	a_arr_char_free(&A_TFR.fr_text, NULL);
+	a_arr_row_free(&A_TFR.fr_rows, NULL);
+	a_arr_char_free(&A_TSFR.fr_text, NULL);
+	a_arr_row_free(&A_TSFR.fr_rows, NULL);
 }
 
-ASHE_PUBLIC a_ubyte ashe_insert_char(a_ubyte c, a_ubyte hidecur)
+ASHE_PUBLIC a_ubyte ashe_insert_char(a_ubyte c)
 {
-	struct a_line newline;
-	a_uint32 idx;
-	a_ubyte relink;
+	if (c == '\n')
+		return ashe_insert_str("\n", 1);
 
 	/* return if input limit would be exceeded */
-	if (a_unlikely(a_arr_len(A_IBF) >= MAXCMDSIZE))
+	if (a_unlikely(a_gapbuf_len(&A_IGB) >= MAXCMDSIZE))
 		return 0;
 
-	/* update state and input buffer */
-	idx = A_IBFIDX;
-	relink = (a_arr_len(A_IBF) >= a_arr_cap(A_IBF));
-	a_arr_char_insert(&A_IBF, idx, c);
-	A_ILINE.len++;
-	if (a_unlikely(relink))
-		relink_lines();
-
-	/* draw */
-	shift_lines_from(A_IROW + 1, 1, +); /* shift right */
-	if (hidecur) dbf_pushlit(a_csi_cursor_hide);
-	dbf_pushlit(a_csi_clear_line_right a_csi_clear_down);
-	if (c == '\n' && A_TCOL < A_TCOLMAX) { /* inside of 'ashe_i_cr()' ? */
-		dbf_pushc('\n');
-		idx++;
-	}
-	dbf_pushlit(a_csi_cursor_save);
-	dbf_push_len(a_arr_char_index(&A_IBF, idx), a_arr_len(A_IBF) - idx);
-	dbf_pushlit(a_csi_cursor_load);
-	if (hidecur) dbf_pushlit(a_csi_cursor_show);
-	dbf_flush();
-
-	if (c == '\n') {
-		newline.start = A_ILINE.start + A_ICOL + 1;
-		newline.len = A_ILINE.len - A_ICOL - 1;
-		newline.trow = A_TROW < A_TROWMAX ? ++A_TROW : A_TROW;
-		newline.flags = 0;
-		a_arr_line_insert(&A_ILINES, A_IROW + 1, newline);
-
-		A_ILINE.len = A_ICOL + 1;
-		A_IBFIDX++;
-		A_IROW++;
-		A_ICOL = 0;
-		A_TCOL = 1;
-		return 1;
-	}
-
-	ashe_move_right();
-	if (A_TROW > A_TROWMAX) {
-		ashe_assert(A_IBFIDX == A_IBF.len);
-		A_TROW--;
-		draw_lit("\n");
-	}
-
-	/* TODO: fix input that is located in scroll area */
+	a_gapbuf_insert(&A_IGB, A_IBFIDX, (char *)&c, 1);
+	line_update(A_IROW, 1, 1);
+	A_IBFIDX++;
+	A_ICOL++;
+	render();
 	return 1;
 }
 
 ASHE_PUBLIC a_ubyte ashe_remove_char(void)
 {
-	struct a_line *l;
-	a_ubyte coalesce;
+	a_memmax len;
+	a_uint32 width, from, idx, w;
 
-	if (A_IBFIDX <= 0)
+	if (A_IBFIDX == 0)
 		return 0;
-	a_arr_char_remove(&A_IBF, A_IBFIDX - 1);
-	shift_lines_from(A_IROW + 1, 1, -); /* shift left */
-	A_ILINE.len -= !(coalesce = (A_ICOL == 0));
-	l = &A_ILINE; /* cache current line */
-	ashe_move_left();
-	if (coalesce) {
+	if (A_ICOL == 0) { /* remove '\n', coalesce with the line above */
 		ashe_assert(A_ILINES.len > 1);
-		A_ILINE.len--; /* '\n' */
-		A_ILINE.len += l->len;
-		a_arr_line_remove(&A_ILINES, A_IROW + 1);
+		a_gapbuf_remove(&A_IGB, A_IBFIDX - 1, 1);
+		len = A_ILINE.len;
+		width = A_ILINE.width;
+		a_arr_line_remove(&A_ILINES, A_IROW);
+		A_IROW--;
+		A_ICOL = A_ILINE.len - 1;
+		A_ILINE.len += len - 1;
+		A_ILINE.width += width;
+		sync_lines_from(A_IROW);
+		a_highlight_edit(&A_IHL, A_IROW, A_IROW, -1);
+		A_IBFIDX--;
+	} else { /* remove the whole character with its combining characters */
+		from = char_prev(A_IBFIDX);
+		for (idx = from, width = 0; idx < A_IBFIDX; width += w)
+			idx += ibf_char(idx, &w);
+		a_gapbuf_remove(&A_IGB, from, A_IBFIDX - from);
+		line_update(A_IROW, -(a_int32)(A_IBFIDX - from), -(a_int32)width);
+		A_ICOL -= A_IBFIDX - from;
+		A_IBFIDX = from;
 	}
-	dbf_pushlit(a_csi_cursor_hide a_csi_clear_line_right a_csi_clear_down a_csi_cursor_save);
-	dbf_push_len(a_arr_char_index(&A_IBF, A_IBFIDX), a_arr_len(A_IBF) - A_IBFIDX);
-	dbf_pushlit(a_csi_cursor_load a_csi_cursor_show);
-	dbf_flush();
+	render();
 	return 1;
 }
 
-/*
- * TODO: needs testing, probably doesn't work, I don't
- * even use it, cba.
- */
 ASHE_PUBLIC a_uint32 ashe_remove_bytes(a_ssize len)
 {
-	struct a_line *line;
-	a_uint32 bufflen, toremove, rmlines, i;
 	a_ssize leftover;
 
-	bufflen = a_arr_len(A_IBF);
-	leftover = bufflen - A_IBFIDX;
-	if (bufflen == 0 || len > leftover)
+	leftover = a_gapbuf_len(&A_IGB) - A_IBFIDX;
+	if (a_gapbuf_len(&A_IGB) == 0 || len > leftover)
 		return 0;
-	if (len < 0 || len == leftover) {
-		toremove = leftover;
-		a_arr_len(A_ILINES) = A_IROW + 1;
-		a_arr_len(A_IBF) = A_IBFIDX + 1;
-		A_ILINE.len = A_ICOL;
-		return toremove;
-	}
-
-	toremove = len;
-	leftover = toremove - (A_ILINE.len - A_ICOL);
-	A_ILINE.len = A_ICOL;
-	rmlines = 0;
-
-	for (i = A_IROW + 1; i < a_arr_len(A_ILINES); i++) {
-		line = a_arr_line_index(&A_ILINES, i);
-		if ((leftover -= line->len) <= 0) {
-			leftover += line->len;
-			break;
-		}
-		rmlines++;
-	}
-
-	if (rmlines > 0)
-		a_arr_line_remove_n(&A_ILINES, A_IROW + 1, rmlines);
-
-	if (leftover >= 0 && A_IROW < a_arr_len(A_ILINES)) { /* coalesce ? */
-		line = a_arr_line_index(&A_ILINES, A_IROW + 1);
-		A_ILINE.len += line->len;
-		A_ILINE.len -= leftover;
-		a_arr_line_remove(&A_ILINES, A_IROW + 1);
-		shift_lines_from(A_IROW + 1, toremove, -);
-	}
-
-	a_arr_char_remove_n(&A_IBF, A_IBFIDX, toremove);
-
-	/* reflect changes on the terminal screen */
-	dbf_pushlit(a_csi_cursor_hide a_csi_clear_line_right a_csi_clear_down a_csi_cursor_save);
-	dbf_push_len(a_arr_char_index(&A_IBF, A_IBFIDX), a_arr_len(A_IBF) - A_IBFIDX);
-	dbf_pushlit(a_csi_cursor_load a_csi_cursor_show);
-	dbf_flush();
-	return 1;
+	if (len < 0)
+		len = leftover;
+	remove_range(A_IBFIDX, A_IBFIDX + len);
+	render();
+	return len;
 }
 
 ASHE_PUBLIC a_ubyte ashe_cr(void)
 {
-	if (ashe_isescaped(a_arr_ptr(A_IBF), A_IBFIDX) || ashe_indq(a_arr_ptr(A_IBF), A_IBFIDX)) {
-		ashe_insert_char('\n', 1);
+	const char *ibf;
+
+	ibf = a_gapbuf_prefix(&A_IGB, A_IBFIDX);
+	if (ashe_isescaped(ibf, A_IBFIDX) || ashe_indq(ibf, A_IBFIDX)) {
+		ashe_insert_str("\n", 1);
 		return 1;
 	}
 	return 0;
@@ -700,22 +2345,25 @@ ASHE_PUBLIC a_ubyte ashe_cr(void)
 /*
  * Prompt must not have newline or else it
  * will mess up cursor navigation.
- * Additionally tabs are removed also because
- * the shell doesn't support tabs (yet).
- *
- * TODO: add support for tabs by adding separate array
- * of graphical bytes for each line.
+ * Tabs are expanded into spaces up to the next
+ * tab stop (every 8 columns), escape sequences
+ * are kept and take no columns.
  */
 ASHE_PRIVATE void sanitize_prompt(void)
 {
-	char *p = a_arr_ptr(A_TP);
-	a_ubyte c;
+	char *p;
+	a_uint32 i, n, w, col;
 
-	while ((c = *p)) {
-		switch (c) {
+	for (i = col = 0; i < A_TPLEN; i += n, col += w) {
+		p = a_arr_char_index(&A_TP, i);
+		switch (*p) {
+		case '\t':
+			for (n = 7 - (col % 8); n > 0; n--)
+				a_arr_char_insert(&A_TP, i, ' ');
+			p = a_arr_char_index(&A_TP, i + 7 - (col % 8));
+			/* fall through */
 		case '\n':
 		case '\r':
-		case '\t':
 		case '\v':
 		case '\f':
 			*p = ' ';
@@ -723,317 +2371,213 @@ ASHE_PRIVATE void sanitize_prompt(void)
 		default:
 			break;
 		}
-		p++;
+		n = text_char(a_arr_char_index(&A_TP, i), A_TPLEN - i, &w);
 	}
 }
 
-ASHE_PUBLIC a_ubyte ashe_draw_prompt_unsafe(void)
+/*
+ * Move the cursor to the first column of a clear row, cursor
+ * model assumes the prompt starts there, even if the output
+ * of the last command did not end with a newline.
+ * If cursor is already in the first column 'A_TCOLMAX' blanks
+ * fill that row and carriage return brings the cursor back,
+ * otherwise the blanks wrap onto the next row.
+ */
+ASHE_PRIVATE void prompt_sol(void)
+{
+	a_uint32 i;
+
+	for (i = 0; i < A_TCOLMAX; i++)
+		dbf_pushc(' ');
+	dbf_pushlit("\r" a_csi_clear_line_right);
+}
+
+/* Expand the prompt template into the prompt buffer. */
+ASHE_PRIVATE void expand_prompt(void)
 {
 	a_arr_len(A_TP) = 0;
-	parse_placeholders(&A_TP, ASHE_PROMPT);
+	if (hsearch.active)
+		search_prompt();
+	else if (picker.active)
+		picker_prompt();
+	else
+		a_userstr_expand(&A_TPT, &A_TP);
 	sanitize_prompt();
 	if (a_unlikely(a_arr_len(A_TP) >= ASHE_USERSTR_MAX)) {
 		a_arr_len(A_TP) = ASHE_USERSTR_MAX - 1;
 		a_arr_char_push(&A_TP, '\0');
 	}
-	ashe_print(a_arr_ptr(A_TP), stderr);
+	sync_promptcols();
+	line_update(0, 0, 0); /* prompt width changed */
+}
+
+/*
+ * Async placeholders that did not make it before the
+ * deadline got computed, redraw the prompt in place.
+ */
+ASHE_PRIVATE void update_prompt(void)
+{
+	if (ashe_collect_placeholders(0)) {
+		expand_prompt();
+		render();
+		a_term_flush();
+	}
+}
+
+ASHE_PUBLIC a_ubyte ashe_draw_prompt_unsafe(void)
+{
+	prompt_sol();
+	ashe_refresh_placeholders();
+	expand_prompt();
+	if (ashe_collect_placeholders(ASHE_PLH_DEADLINE_MS))
+		expand_prompt();
+	shadow_reset();
+	render();
 	return 1;
 }
 
 ASHE_PUBLIC void ashe_redraw_prompt(void)
 {
-	ashe_move_to_end();
+	a_ubyte suggested;
+
+	if (picker.active)
+		picker_end(0);
+	suggested = suggesting;
+	leave_input();
+	suggesting = suggested;
 	a_input_clear();
-	ashe_print("\r\n", stderr);
+	dbf_pushlit("\r\n");
 	ashe_draw_prompt_unsafe();
+	a_term_flush();
+#ifdef ASHE_DBG_CURSOR
+	a_term_resync_cursor(); /* new anchor for 'a_term_check_cursor()' */
+#else
 	a_term_sync_cursor();
+#endif
 }
 
 ASHE_PUBLIC a_ubyte ashe_move_left(void)
 {
-	if (A_ICOL > 0) {
-		A_ICOL--;
-		if (A_TCOL == 1) {
-			A_TCOL = A_TCOLMAX;
-			goto lineuptocol;
-		} else {
-			A_TCOL--;
-			draw_lit(a_csi_cursor_left(1));
-		}
-	} else if (A_IROW > 0) {
-		A_IROW--;
-		A_ICOL = A_ILINE.len - 1;
-		A_TCOL = tcol(A_ILINE.len + ((A_IROW == 0) * A_TPLEN));
-lineuptocol:
-		A_TROW--;
-		dbf_pushlit(a_csi_cursor_up(1));
-		dbf_push_movecol(A_TCOL);
-		dbf_flush();
-	} else {
+	if (A_IBFIDX == 0)
 		return 0;
-	}
-	A_IBFIDX--;
+	set_cursor(char_prev(A_IBFIDX));
+	render();
 	return 1;
 }
 
 ASHE_PUBLIC a_ubyte ashe_move_right(void)
 {
-	if (A_ICOL < A_ILINE.len - (A_IROW < A_ILINES.len - 1)) {
-		A_ICOL++;
-		if (A_TCOL < A_TCOLMAX) {
-			A_TCOL++;
-			draw_lit(a_csi_cursor_right(1));
-		} else {
-			goto firstcoldown;
-		}
-	} else if (A_IROW < (A_ILINES.len - 1)) {
-		A_IROW++;
-		A_ICOL = 0;
-firstcoldown:
-		A_TROW++;
-		A_TCOL = 1;
-		draw_lit(a_csi_cursor_down(1) a_csi_cursor_col(1));
-	} else {
+	if (A_IBFIDX == a_gapbuf_len(&A_IGB))
 		return 0;
-	}
-	A_IBFIDX++;
+	set_cursor(char_next(A_IBFIDX));
+	render();
 	return 1;
 }
 
 ASHE_PUBLIC a_ubyte ashe_move_down(void)
 {
-	ashe_assert(A_ILINES.len > 0);
-	a_uint32 extra = (A_IROW == 0) * A_TPLEN;
-	a_ubyte notlastrow = (A_IROW < A_ILINES.len - 1);
-	a_uint32 linewraps = (A_ILINE.len != 0) * trowdiffx(A_ILINE.len + extra - notlastrow);
-	a_uint32 colwraps = (A_ICOL != 0) * trowdiffx(A_ICOL + extra);
-	a_ssize wraps = linewraps - colwraps;
-	a_ubyte temp;
-
-	if (wraps > 0) {
-		if (wraps > 1 || A_ICOL + extra + A_TCOLMAX <= A_ILINE.len + extra - 1) {
-			A_ICOL += A_TCOLMAX;
-			A_IBFIDX += A_TCOLMAX;
-			goto down;
-		} else {
-			temp = (A_IROW < A_ILINES.len - 1);
-			A_IBFIDX += A_ILINE.len - A_ICOL - temp;
-			A_ICOL = A_ILINE.len - temp;
-			A_TCOL = tcol(A_ILINE.len + extra + !temp);
-			goto downtocol;
-		}
-	} else if (A_IROW < A_ILINES.len - 1) {
-		A_IBFIDX += A_ILINE.len - A_ICOL; /* start of new line */
-		A_IROW++;
-		if (A_ILINE.len >= A_TCOLMAX || A_ILINE.len >= tcol(A_ICOL + 1 + extra)) {
-			A_IBFIDX += A_TCOL - 1;
-			A_ICOL = A_TCOL - 1;
-down:
-			dbf_pushlit(a_csi_cursor_down(1));
-			goto flush;
-		} else {
-			temp = (A_IROW != A_ILINES.len - 1);
-			A_IBFIDX += A_ILINE.len - temp;
-			A_ICOL = A_ILINE.len - temp;
-			A_TCOL = A_ILINE.len + !temp;
-downtocol:
-			dbf_pushlit(a_csi_cursor_down(1));
-			dbf_push_movecol(A_TCOL);
-flush:
-			dbf_flush();
-		}
-		A_TROW++;
-		return 1;
-	}
-	return 0;
+	if (A_TROW >= input_endrow())
+		return 0;
+	set_cursor(cursor_index(A_TROW + 1, A_TCOL));
+	render();
+	return 1;
 }
 
 ASHE_PUBLIC a_ubyte ashe_move_up(void)
 {
-	a_uint32 extra = ((A_IROW == 0) * A_TPLEN);
-	a_uint32 len = A_ICOL + 1 + extra;
-	a_uint32 pwraps = (A_TPLEN != 0) * ((A_TPLEN - 1) / A_TCOLMAX);
-	a_uint32 lwraps = (len - 1) / A_TCOLMAX;
-	a_uint32 temp;
-
-	temp = lwraps - pwraps;
+	a_uint32 idx;
 
-	if (A_IROW == 0 && (temp == 0 || (temp < 2 && len % A_TCOLMAX == 0)))
+	if (A_TROW == 0 || (idx = cursor_index(A_TROW - 1, A_TCOL)) == A_IBFIDX)
 		return 0;
-
-	if (A_IROW == 0) {
-		if (temp == 1 && (temp = tcol(A_TPLEN)) >= tcol(len)) {
-start:
-			A_ICOL = 0;
-			A_IBFIDX = 0;
-			A_TCOL = temp;
-			goto uptocol_draw;
-		} else {
-			goto up;
-		}
-	} else if (lwraps == 0) {
-		A_IBFIDX -= A_ICOL + 1; /* end of the line above */
-		A_IROW--;
-		extra = (A_IROW == 0) * A_TPLEN;
-		len = A_ILINE.len + extra;
-		lwraps = (len - 1) / A_TCOLMAX;
-		if ((temp = tcol(len)) <= A_ICOL + 1) {
-			A_ICOL = A_ILINE.len - 1;
-			A_TCOL = temp;
-			goto uptocol_draw;
-		} else {
-			temp = tcol(A_ICOL + 1);
-			if (A_IROW == 0 && lwraps - pwraps == 0 && tcol(A_TPLEN) >= temp) {
-				temp = tcol(A_TPLEN + 1);
-				goto start;
-			}
-			temp = tcol(len) - temp;
-			A_ICOL = A_ILINE.len - temp - 1;
-			A_IBFIDX -= temp;
-			goto up_draw;
-		}
-	} else { /* lwraps > 0 */
-up:
-		A_ICOL -= A_TCOLMAX;
-		A_IBFIDX -= A_TCOLMAX;
-up_draw:
-		dbf_pushlit(a_csi_cursor_up(1));
-		goto flush;
-	}
-uptocol_draw:
-	dbf_pushlit(a_csi_cursor_up(1));
-	dbf_push_movecol(A_TCOL);
-flush:
-	dbf_flush();
-	A_TROW--;
+	set_cursor(idx);
+	render();
 	return 1;
 }
 
 ASHE_PUBLIC a_ubyte ashe_move_to_eol(void)
 {
-	a_uint32 extra = (A_IROW == 0) * A_TPLEN;
-	a_uint32 col = A_ICOL + extra;
-	a_uint32 len = A_ILINE.len + extra;
-	a_uint32 temp;
-	a_ubyte isnotlastrow = !(A_ILINES.len == 1 || A_IROW == A_ILINES.len - 1);
-
-	if (A_ILINE.len > 0 &&
-	    ((temp = tcol(col + 1)) != A_TCOLMAX || A_ICOL != A_ILINE.len - isnotlastrow)) {
-		ashe_assert(A_ILINE.len != 0);
-		if (trowdiffx(col) < trowdiffx(len)) {
-			A_TCOL = A_TCOLMAX;
-			A_ICOL += A_TCOLMAX - temp;
-			A_IBFIDX += A_TCOLMAX - temp;
-		} else {
-			A_TCOL = tcol(len) + !isnotlastrow;
-			A_IBFIDX += A_ILINE.len - A_ICOL - isnotlastrow;
-			A_ICOL = A_ILINE.len - isnotlastrow;
-		}
-		dbf_push_movecol(A_TCOL);
-		dbf_flush();
-		return 1;
-	}
-	return 0;
+	a_uint32 idx;
+
+	if ((idx = cursor_index(A_TROW, A_TCOLMAX)) == A_IBFIDX)
+		return 0;
+	set_cursor(idx);
+	render();
+	return 1;
 }
 
 ASHE_PUBLIC a_ubyte ashe_move_to_sol(void)
 {
-	a_uint32 extra = (A_IROW == 0) * A_TPLEN;
-	a_uint32 col = A_ICOL + extra;
-	a_ssize temp;
+	a_uint32 idx;
 
-	if (A_ICOL != 0 && (temp = tcol(col + 1)) != 1) {
-		if (col < A_TCOLMAX) {
-			A_IBFIDX -= A_ICOL;
-			A_ICOL = 0;
-			A_TCOL = extra + 1;
-		} else {
-			A_IBFIDX -= temp - 1;
-			A_ICOL -= temp - 1;
-			col = A_ICOL + extra;
-			A_TCOL = tcol(col + 1);
-		}
-		dbf_push_movecol(A_TCOL);
-		dbf_flush();
-		return 1;
-	}
-	return 0;
+	if ((idx = cursor_index(A_TROW, 1)) == A_IBFIDX)
+		return 0;
+	set_cursor(idx);
+	render();
+	return 1;
 }
 
 ASHE_PUBLIC void ashe_clear_screen_unsafe(void)
 {
-	draw_lit(a_csi_cursor_hide a_csi_cursor_home a_csi_clear_all a_csi_cursor_show);
+	dbf_pushlit(a_csi_cursor_hide a_csi_cursor_home a_csi_clear_all a_csi_cursor_show);
 }
 
 ASHE_PUBLIC void ashe_clear_screen_and_redraw(void)
 {
 	ashe_clear_screen_unsafe();
 	ashe_draw_prompt_unsafe();
-	ashe_redraw_input_unsafe();
-	a_term_sync_cursor();
+#ifdef ASHE_DBG_CURSOR
+	A_ISROW = 1; /* prompt starts at the top */
+#endif
 }
 
-/* Only draws to the terminal screen. */
+/* Render the input, only what changed gets drawn. */
 ASHE_PUBLIC void ashe_redraw_input_unsafe(void)
 {
-	dbf_pushlit(a_csi_cursor_hide);
-	dbf_push_len(a_arr_ptr(A_IBF), A_IBFIDX);
-	dbf_pushlit(a_csi_cursor_save);
-	dbf_push_len(a_arr_ptr(A_IBF) + A_IBFIDX, a_arr_len(A_IBF) - A_IBFIDX);
-	dbf_pushlit(a_csi_cursor_load a_csi_cursor_show);
-	dbf_flush();
+	render();
 }
 
-ASHE_PUBLIC a_ubyte ashe_move_to_start(void)
+ASHE_PUBLIC a_ubyte ashe_move_word_right(void)
 {
-	a_int32 up;
+	a_uint32 idx, len;
 
-	if (A_IBFIDX == 0) /* already at start ? */
+	len = a_gapbuf_len(&A_IGB);
+	for (idx = A_IBFIDX; idx < len && isworddelim(a_gapbuf_at(&A_IGB, idx)); idx++);
+	for (; idx < len && !isworddelim(a_gapbuf_at(&A_IGB, idx)); idx++);
+	if (idx == A_IBFIDX)
 		return 0;
+	set_cursor(idx);
+	render();
+	return 1;
+}
 
-	/* update input buffer */
-	up = first_row_diff(0);
-	A_TROW -= up;
-	A_TCOL = tcol(A_TPLEN + 1);
-	A_IBFIDX = 0;
-	A_ICOL = 0;
-	A_IROW = 0;
+ASHE_PUBLIC a_ubyte ashe_move_word_left(void)
+{
+	a_uint32 idx;
 
-	/* update terminal cursor */
-	dbf_pushlit(a_csi_cursor_hide);
-	if (up > 0) dbf_push_moveup(up);
-	dbf_push_movecol(A_TCOL);
-	dbf_pushlit(a_csi_cursor_show);
-	dbf_flush();
+	for (idx = A_IBFIDX; idx > 0 && isworddelim(a_gapbuf_at(&A_IGB, idx - 1)); idx--);
+	for (; idx > 0 && !isworddelim(a_gapbuf_at(&A_IGB, idx - 1)); idx--);
+	if (idx == A_IBFIDX)
+		return 0;
+	set_cursor(idx);
+	render();
+	return 1;
+}
 
+ASHE_PUBLIC a_ubyte ashe_move_to_start(void)
+{
+	if (A_IBFIDX == 0) /* already at start ? */
+		return 0;
+	set_cursor(0);
+	render();
 	return 1;
 }
 
 ASHE_PUBLIC a_ubyte ashe_move_to_end(void)
 {
-	struct a_line *line;
-	a_uint32 lines, down;
-
-	if (A_IBFIDX == a_arr_len(A_IBF)) /* already at end ? */
+	if (A_IBFIDX == a_gapbuf_len(&A_IGB)) /* already at end ? */
 		return 0;
-
-	/* update input buffer */
-	down = last_row_diff();
-	lines = a_arr_len(A_ILINES);
-	line = a_arr_line_last(&A_ILINES);
-	A_IBFIDX = a_arr_len(A_IBF);
-	A_IROW = lines - (lines == 0);
-	A_ICOL = line->len + (lines == 0) * A_TPLEN;
-	A_IROW += down;
-	A_TCOL = tcol(A_ICOL);
-
-	/* update terminal cursor */
-	dbf_pushlit(a_csi_cursor_hide);
-	dbf_push_movedown(down);
-	dbf_push_movecol(tcol(A_ICOL));
-	dbf_pushlit(a_csi_cursor_show);
-	dbf_flush();
-
+	set_cursor(a_gapbuf_len(&A_IGB));
+	render();
 	return 1;
 }
 
@@ -1043,20 +2587,15 @@ ASHE_PUBLIC a_ubyte ashe_move_to_end(void)
  */
 ASHE_PUBLIC void sigwinch_redraw(void)
 {
-	a_int32 up;
+	a_uint32 up;
 
-	up = first_row_diff(1);
+	up = A_TROW - A_TVTOP; /* viewport rows above the cursor (old dimensions) */
 	a_term_sync_dimensions();
-	up -= A_TCOLMAX == 1;
 	dbf_pushlit(a_csi_cursor_hide);
 	if (up > 0)
 		dbf_push_moveup(up);
-	dbf_pushlit(a_csi_cursor_col(1) a_csi_clear_line_right a_csi_clear_down);
-	dbf_push_len(a_arr_ptr(A_TP), A_TPLEN);
-	dbf_push_len(a_arr_ptr(A_IBF), A_IBFIDX);
-	dbf_pushlit(a_csi_cursor_save);
-	dbf_push_len(a_arr_char_index(&A_IBF, A_IBFIDX), a_arr_len(A_IBF) - A_IBFIDX);
-	dbf_pushlit(a_csi_cursor_load a_csi_cursor_show);
-	dbf_flush();
-	a_term_sync_cursor();
-}
+	dbf_pushlit("\r" a_csi_clear_down a_csi_cursor_show);
+	shadow_reset();
+	render();
+	a_term_flush();
+}
\ No newline at end of file
@@ -20,6 +20,11 @@
 #include "acommon.h"
 #include "aarray.h"
 #include "atoken.h"
+#include "agapbuf.h"
+#include "afenwick.h"
+#include "autf8.h"
+#include "auserstr.h"
+#include "ahighlight.h"
 
 #include <termios.h>
 
@@ -29,6 +34,8 @@
 /* terminal members */
 #define A_TP	  A_TM.tm_prompt
 #define A_TPLEN	  (a_arr_len(A_TM.tm_prompt) - 1)
+#define A_TPCOLS  A_TM.tm_promptcols
+#define A_TPT	  A_TM.tm_ptemplate
 #define A_TDBF	  A_TM.tm_dbf
 #define A_TIODFL  A_TM.tm_dfltermios
 #define A_TIORAW  A_TM.tm_rawtermios
@@ -36,11 +43,17 @@
 #define A_TCOLMAX A_TM.tm_columns
 #define A_TCOL	  A_TM.tm_col
 #define A_TROW	  A_TM.tm_row
+#define A_TKBF	  A_TM.tm_kbf
+#define A_TFR	  A_TM.tm_frame
+#define A_TSFR	  A_TM.tm_shadow
+#define A_TOS	  A_TM.tm_outstat
+#define A_TVTOP	  A_TM.tm_vtop
 
 /* input */
 #define A_TI A_TM.tm_input
 
 /* input members */
+#define A_IGB	 A_TI.in_gb
 #define A_IBF	 A_TI.in_ibf
 #define A_IBFIDX A_TI.in_ibfidx
 #define A_ILINES A_TI.in_lines
@@ -49,48 +62,135 @@
 #define A_ILINE	 a_arr_ptr(A_ILINES)[A_IROW]
 #define A_ISROW	 A_TI.in_startrow
 #define A_ISCOL	 A_TI.in_startcol
+#define A_ILENFW A_TI.in_lenfw
+#define A_IROWFW A_TI.in_rowfw
+#define A_IHL	 A_TI.in_hl
+
+/* offset of the input line 'i' in the input buffer */
+#define a_input_lineoff(i) a_fenwick_sum(&A_ILENFW, i)
 
 struct a_line { /* input line */
-	char *start;
 	a_memmax len;
-
-	/* TODO: implement line flags and trow in order to move
-	 * cursor up properly up after terminal scrolls down. */
-	a_uint32 trow;
-#define ALF_SCROLLWIN 0x01 /* last char will scroll window */
-	a_ubyte flags;
+	a_uint32 width; /* display width, excluding '\n' */
+	a_uint32 rows; /* terminal rows the line spans */
 };
 
 ARRAY_NEW(a_arr_line, struct a_line)
 
 /* terminal input */
 struct a_input {
-	/* input buffer and current cursor index within it */
-	a_arr_char in_ibf;
+	/* input buffer (gap buffer) and current cursor
+	 * index within it */
+	struct a_gapbuf in_gb;
 	a_uint32 in_ibfidx;
 
+	/* accepted input (contiguous, null terminated),
+	 * filled from 'in_gb' once the reading is done */
+	a_arr_char in_ibf;
+
 	/* input lines */
 	a_arr_line in_lines;
 	a_uint32 in_col;
 	a_uint32 in_row;
 
-	/* terminal row and col where the input starts */
+	/* prefix sums over the input lines, lengths (line
+	 * offsets) and terminal rows each line spans */
+	struct a_fenwick in_lenfw;
+	struct a_fenwick in_rowfw;
+
+	/* syntax highlighting of the input lines */
+	struct a_highlight in_hl;
+
+	/* terminal row and col where the prompt starts
+	 * (absolute, only valid after cursor resync) */
 	a_uint32 in_startrow;
 	a_uint32 in_startcol;
 };
 
 void a_input_clear(void);
 
+/* terminal frame row */
+struct a_row {
+	a_uint32 off; /* offset in the frame text */
+	a_uint32 len; /* length in bytes */
+	a_uint32 width; /* display width (columns) */
+};
+
+ARRAY_NEW(a_arr_row, struct a_row)
+
+/*
+ * Terminal frame, prompt and input laid out into
+ * terminal rows, row 0 is the row where prompt starts.
+ */
+struct a_frame {
+	a_arr_char fr_text;
+	a_arr_row fr_rows;
+	a_uint32 fr_skip; /* rows to drop before the first row is kept */
+	a_ubyte fr_hl; /* highlight at the end of the last row */
+};
+
+/* initial size of the terminal key buffer */
+#define A_KBFSIZE 4096
+
+/* terminal key buffer (input decoder) */
+struct a_keybuf {
+	/* bytes read from the terminal, 'kb_pos' is
+	 * the first byte that was not decoded yet */
+	char *kb_buf;
+	a_uint32 kb_cap; /* grows only when full of bytes not decoded yet */
+	a_uint32 kb_pos;
+	a_uint32 kb_len;
+	a_uint32 kb_cooked; /* typeahead left to read (see 'kbf_typeahead()') */
+
+	/* contents of the last bracketed paste */
+	a_arr_char kb_paste;
+
+	/* last multibyte (UTF-8) character key */
+	char kb_char[4];
+	a_ubyte kb_charlen;
+};
+
+/* terminal output statistics (frames written by 'a_term_flush()') */
+struct a_outstat {
+	a_uint64 os_frames; /* frames written */
+	a_uint64 os_bytes; /* bytes written */
+	a_uint64 os_writes; /* write syscalls */
+	a_uint32 os_lastbytes; /* bytes in the last frame */
+	a_uint32 os_lastwrites; /* write syscalls for the last frame */
+};
+
 struct a_term {
-	/* prompt buffer */
+	/* prompt buffer and the compiled prompt
+	 * template ('ASHE_PROMPT') it is expanded from */
 	a_arr_char tm_prompt;
+	struct a_userstr tm_ptemplate;
+
+	/* terminal position where the input starts after
+	 * the prompt, 'row * tm_columns + col' (cursor model) */
+	a_uint32 tm_promptcols;
 
 	/* terminal input */
 	struct a_input tm_input;
 
-	/* terminal draw buffer */
+	/* terminal draw buffer, holds the frame
+	 * until 'a_term_flush()' writes it out */
 	a_arr_char tm_dbf;
 
+	/* terminal output statistics */
+	struct a_outstat tm_outstat;
+
+	/* terminal key buffer */
+	struct a_keybuf tm_kbf;
+
+	/* frame that is currently on the screen (shadow)
+	 * and the frame that is being rendered */
+	struct a_frame tm_shadow;
+	struct a_frame tm_frame;
+
+	/* set if terminal supports synchronized output,
+	 * -1 if the terminal was not queried yet */
+	a_byte tm_syncout;
+
 	/* terminal io */
 	struct termios tm_dfltermios;
 	struct termios tm_rawtermios;
@@ -99,10 +199,17 @@ struct a_term {
 	a_uint32 tm_rows;
 	a_uint32 tm_columns;
 
-	/* cursor position in terminal */
+	/* cursor position in terminal, column is absolute,
+	 * row is relative to the prompt start, renderer keeps
+	 * it equal to the cursor model after each frame */
 	a_uint32 tm_col;
 	a_uint32 tm_row;
 
+	/* viewport, first row (relative to the prompt start) of
+	 * the at most 'tm_rows' rows that are shown, frames only
+	 * hold the rows of the viewport */
+	a_uint32 tm_vtop;
+
 	/* set if reading input */
 	a_ubyte tm_reading;
 };
@@ -116,9 +223,35 @@ void a_term_free(void);
 /* Update terminal dimensions. */
 void a_term_sync_dimensions(void);
 
-/* Update terminal cursor position. */
+/*
+ * Update terminal cursor position from the cursor model
+ * (prompt width, input lines and terminal dimensions).
+ * This does not query the terminal.
+ */
 void a_term_sync_cursor(void);
 
+/*
+ * Query the terminal for the real cursor position
+ * and re-anchor the cursor model to it (explicit resync).
+ */
+void a_term_resync_cursor(void);
+
+#ifdef ASHE_DBG_CURSOR
+/*
+ * Check the cursor model against the real cursor position,
+ * returns 0 if they differ.
+ */
+a_ubyte a_term_check_cursor(a_uint32 *realrow, a_uint32 *realcol);
+#endif
+
+/*
+ * Write out the frame accumulated in the draw buffer.
+ * Editing and drawing functions only append to the draw
+ * buffer, the frame is written once per key event (or once
+ * per signal/redraw outside of the key loop).
+ */
+void a_term_flush(void);
+
 /* Start reading from terminal. */
 void a_term_read(void);
 
@@ -134,11 +267,18 @@ void sigwinch_redraw(void); // TODO: test
  *
  * If the input size limit is reached, character
  * won't get inserted and return value will be 0.
+ */
+a_ubyte ashe_insert_char(a_ubyte c);
+
+/*
+ * Insert 'len' bytes of 's' (newlines included) under
+ * the cursor as a single edit and update cursor.
+ * Input lines are rebuilt and the input is redrawn once.
  *
- * If 'hidecur' is true, then cursor will be hidden
- * until screen is redrawn.
+ * Returns the number of bytes inserted, which is less
+ * than 'len' if the input size limit would be exceeded.
  */
-a_ubyte ashe_insert_char(a_ubyte c, a_ubyte hidecur);
+a_uint32 ashe_insert_str(const char *s, a_uint32 len);
 
 /*
  * Remove character under the cursor from the
@@ -167,7 +307,7 @@ a_ubyte ashe_remove_char(void);
  * to the end of the input buffer, return value
  * is 0 and removal is not performed.
  */
-a_uint32 ashe_remove_bytes(a_ssize len); // TODO: test
+a_uint32 ashe_remove_bytes(a_ssize len);
 
 /*
  * Insert new line under the cursor and move the
@@ -240,6 +380,23 @@ a_ubyte ashe_move_to_sol(void);
  */
 void ashe_clear_screen_and_redraw(void);
 
+/*
+ * Moves cursor forward to the end of the word,
+ * words are separated by blanks and newlines.
+ *
+ * If the cursor was already after the last word
+ * this returns 0.
+ */
+a_ubyte ashe_move_word_right(void);
+
+/*
+ * Moves cursor back to the start of the word.
+ *
+ * If the cursor was already before the first word
+ * this returns 0.
+ */
+a_ubyte ashe_move_word_left(void);
+
 /*
  * Moves cursor to the start of the input buffer.
  *
@@ -267,7 +424,12 @@ void ashe_clearinput(void);
  */
 void ashe_deletefront(void);
 
+/*
+ * Removes text behind the cursor.
+ */
+void ashe_deleteback(void);
 
+/* Functions below only append to the draw buffer ('a_term_flush()'). */
 a_ubyte ashe_draw_prompt_unsafe(void);
 void ashe_redraw_input_unsafe(void);
 void ashe_clear_screen_unsafe(void);
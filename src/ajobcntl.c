@@ -445,10 +445,9 @@ ASHE_PRIVATE void a_jobcntl_update(struct a_jobcntl *jobcntl)
 /*
  * Updates the 'JobControl' by removing all of the finished jobs.
  * Additionally reports any of the jobs that were completed and/or stopped.
- * In most cases gets called inside the signal handler, so we have to take
- * care of the terminal input and about redrawing the screen properly.
- * Calling this directly without masking off the other signals with
- * SIG_BLOCK is highly unsafe and will probably break something.
+ * In most cases gets called while reading the input (on SIGCHLD
+ * from the signalfd), so we have to take care of the terminal input
+ * and about redrawing the screen properly.
  */
 ASHE_PUBLIC void a_jobcntl_update_and_notify(struct a_jobcntl *jobcntl)
 {
@@ -485,6 +484,7 @@ notify:
 				row = A_IROW;
 				idx = A_IBFIDX;
 				ashe_move_to_end();
+				a_term_flush();
 				ashe_print("\r\n", stderr);
 			}
 
@@ -497,8 +497,12 @@ notify:
 				A_IROW = row;
 				A_IBFIDX = idx;
 				ashe_redraw_input_unsafe();
-				a_term_sync_cursor();
 			}
+			a_term_flush();
+#ifdef ASHE_DBG_CURSOR
+			if (term->tm_reading) /* new anchor for 'a_term_check_cursor()' */
+				a_term_resync_cursor();
+#endif
 
 			if (completed) {
 				a_job_free(job);
@@ -54,8 +54,9 @@ ASHE_PRIVATE inline void a_token_init(struct a_token *token)
 ASHE_PUBLIC void a_lexer_init(struct a_lexer *lexer, const char *start)
 {
 	lexer->current = lexer->start = start;
-	a_token_init(&A_CTOK);
-	a_token_init(&A_PTOK);
+	lexer->scan = lexer->dq = 0;
+	a_token_init(&lexer->curr);
+	a_token_init(&lexer->prev);
 }
 
 /* Peek 'amount' without advancing. */
@@ -92,47 +93,59 @@ ASHE_PRIVATE a_int32 all_chars_are_digits(const char *str, a_memmax *n)
 	return 0;
 }
 
+/* Return 1 if the word ['s', 'end') is 'key=value'. */
+ASHE_PRIVATE a_ubyte iskvpair(const char *s, const char *end)
+{
+	const char *p;
+
+	for (p = s; p < end && *p != '='; p++)
+		if (!strchr(ENV_VAR_CHARS, *p))
+			return 0;
+	return (p > s && p < end);
+}
+
 /* Gets a string, expands environmental variables and unescapes it. */
 ASHE_PRIVATE struct a_token a_token_string(struct a_lexer *lexer)
 {
 	struct a_token token = { 0 };
 	a_arr_char buffer;
-	a_memmax n, klen;
-	char *ptr;
+	a_memmax n;
 	a_int32 c, code;
 	a_ubyte dq, esc;
 
-	a_arr_char_init(&buffer);
 	token.type = TK_WORD;
 	token.start = lexer->current;
-	dq = esc = 0;
+	dq = lexer->dq;
+	esc = 0;
 
 	while ((c = peek(lexer, 0))) {
 		if (!dq && (isspace(c) || (!esc && has_precedence(c))))
 			break;
 		dq ^= (!esc && c == '"');
 		esc ^= (c == '\\' || esc);
-		a_arr_char_push(&buffer, c);
 		advance(lexer);
 	}
 	token.end = lexer->current;
-	a_arr_char_push(&buffer, '\0');
+
+	if (lexer->scan) {
+		lexer->dq = dq;
+		if (iskvpair(token.start, token.end))
+			token.type = TK_KVPAIR;
+		return token;
+	}
 
 	if (a_unlikely(c == '\0' && dq)) {
-		a_arr_char_free(&buffer, NULL);
 		token.u.error = "expected '\"', instead got 'EOL'";
 		token.type = TK_ERROR;
+		return token;
 	}
 
-	ptr = a_arr_ptr(buffer);
-	if (*ptr != '=' && (ptr = strstr(ptr, "=")) != NULL) {
-		*ptr = '\0';
-		klen = strlen(a_arr_ptr(buffer));
-		if (strspn(a_arr_ptr(buffer), ENV_VAR_CHARS) == klen)
-			token.type = TK_KVPAIR;
-		*ptr = '=';
-	}
+	if (iskvpair(token.start, token.end))
+		token.type = TK_KVPAIR;
 
+	a_arr_char_init_cap(&buffer, token.end - token.start + 1);
+	a_arr_char_push_str(&buffer, token.start, token.end - token.start);
+	a_arr_char_push(&buffer, '\0');
 	ashe_escape(&buffer);
 
 	if (buffer.len == 2 && a_arr_ptr(buffer)[0] == '-') {
@@ -162,7 +175,7 @@ ASHE_PRIVATE void skipws(struct a_lexer *lexer)
 		switch (c) {
 		case '#':
 			advance(lexer);
-			while ((c = peek(lexer, 0)) != '\n' && c != '\v')
+			while ((c = peek(lexer, 0)) != '\n' && c != '\v' && c != '\0')
 				advance(lexer);
 			break;
 		case '\n':
@@ -179,12 +192,13 @@ ASHE_PRIVATE void skipws(struct a_lexer *lexer)
 	}
 }
 
-ASHE_PRIVATE inline struct a_token a_token_new(enum a_toktype type, const char *start)
+ASHE_PRIVATE inline struct a_token a_token_new(struct a_lexer *lexer, enum a_toktype type,
+					       const char *start)
 {
 	struct a_token token;
 	token.type = type;
 	token.start = start;
-	token.end = ashe.sh_lexer.current;
+	token.end = lexer->current;
 	return token;
 }
 
@@ -194,12 +208,14 @@ ASHE_PUBLIC struct a_token a_lexer_next(struct a_lexer *lexer)
 	enum a_toktype type;
 	const char *start;
 
+	if (lexer->dq && peek(lexer, 0) != '\0') /* word continues */
+		return a_token_string(lexer);
 	skipws(lexer);
 
 	start = lexer->current;
 	if ((c = peek(lexer, 0)) == '\0') {
 		advance(lexer);
-		return a_token_new(TK_EOL, start);
+		return a_token_new(lexer, TK_EOL, start);
 	}
 
 	switch (c) {
@@ -289,5 +305,5 @@ ASHE_PUBLIC struct a_token a_lexer_next(struct a_lexer *lexer)
 	}
 
 	advance(lexer);
-	return a_token_new(type, start);
+	return a_token_new(lexer, type, start);
 }
@@ -24,6 +24,11 @@ struct a_lexer {
 	struct a_token prev;
 	const char *current; /* debug */
 	const char *start; /* debug */
+	/* Scanning only finds the token bounds and types (no strings
+	 * get built), word that ends inside of '"' sets 'dq' and the
+	 * next token continues it, so input can be scanned in chunks. */
+	a_ubyte scan;
+	a_ubyte dq;
 };
 
 /* global lexer */
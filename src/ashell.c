@@ -19,6 +19,7 @@
 #include "aasync.h"
 #include "acommon.h"
 #include "aconf.h"
+#include "afuzzy.h"
 #include "ashell.h"
 #include "auserstr.h"
 #ifdef ASHE_DBG
@@ -74,6 +75,7 @@ ASHE_PUBLIC void a_shell_init(struct a_shell *sh)
 #endif
 	memset(sh, 0, sizeof(struct a_shell));
 	ashe_inithist(&sh->sh_history, NULL, canfail);
+	a_cmdindex_init(&sh->sh_cmdindex);
 	sh_pgid = ashe_getpgrp();
 	a_arr_ccharp_init_cap(&sh->sh_strings, 8);
 	a_arr_char_init_cap(&sh->sh_status, 8);
@@ -109,6 +111,10 @@ ASHE_PUBLIC void a_shell_free(struct a_shell *sh)
 	a_term_free();
 	a_arr_ccharp_free(&sh->sh_strings, ashe_free_ccharp);
 	a_arr_char_free(&sh->sh_welcome, NULL);
+	ashe_free_placeholders();
+	a_cmdindex_free(&sh->sh_cmdindex);
+	ashe_pathcompl_free();
+	ashe_fuzzy_stop();
 	a_arr_char_free(&sh->sh_status, NULL);
 	a_block_free(&sh->sh_block);
 }
@@ -22,6 +22,7 @@
 #include "ainput.h"
 #include "ajobcntl.h"
 #include "ahist.h"
+#include "acompl.h"
 
 #include <signal.h>
 #include <setjmp.h>
@@ -57,8 +58,8 @@ struct a_shell {
 	struct a_jmpbuf sh_buf;
 	struct a_flags sh_flags;
 	struct a_settings sh_settings;
-	volatile sig_atomic_t sh_int; /* set if we got interrupted */
 	struct a_histlist sh_history;
+	struct a_cmdindex sh_cmdindex; /* command names for completion */
 	a_ubyte sh_dirtyfd[3]; /* fd flags */
 };
 
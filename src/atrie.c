@@ -0,0 +1,122 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#include "atrie.h"
+
+
+#define trienode(tr, i) a_arr_trienode_index(&(tr)->tr_nodes, i)
+
+
+ASHE_PUBLIC void a_trie_init(struct a_trie *tr)
+{
+	a_arr_trienode_init(&tr->tr_nodes);
+	tr->tr_free = 0;
+}
+
+ASHE_PUBLIC void a_trie_free(struct a_trie *tr)
+{
+	a_arr_trienode_free(&tr->tr_nodes, NULL);
+	a_trie_init(tr);
+}
+
+/* Child of node 'i' for the byte 'c', 0 if there is none. */
+ASHE_PRIVATE a_uint32 find_child(const struct a_trie *tr, a_uint32 i, a_ubyte c)
+{
+	for (i = trienode(tr, i)->child; i != 0 && trienode(tr, i)->c != c; i = trienode(tr, i)->next);
+	return i;
+}
+
+/* New node for the byte 'c' as the first child of node 'parent'. */
+ASHE_PRIVATE a_uint32 new_child(struct a_trie *tr, a_uint32 parent, a_ubyte c)
+{
+	struct a_trienode *node;
+	a_uint32 i;
+
+	if (tr->tr_free != 0) {
+		i = tr->tr_free;
+		tr->tr_free = trienode(tr, i)->next;
+	} else {
+		i = a_arr_trienode_push(&tr->tr_nodes, (struct a_trienode){ 0 });
+	}
+	node = trienode(tr, i);
+	node->child = 0;
+	node->next = trienode(tr, parent)->child;
+	node->c = c;
+	trienode(tr, parent)->child = i;
+	return i;
+}
+
+ASHE_PUBLIC void a_trie_add(struct a_trie *tr, a_uint32 id, const char *text, a_uint32 len)
+{
+	a_uint32 i, k, child;
+
+	if (a_unlikely(a_arr_len(tr->tr_nodes) == 0))
+		a_arr_trienode_push(&tr->tr_nodes, (struct a_trienode){ 0 }); /* root */
+	i = 0;
+	trienode(tr, i)->id = id;
+	for (k = 0; k < len; k++, i = child) {
+		if ((child = find_child(tr, i, text[k])) == 0)
+			child = new_child(tr, i, text[k]);
+		trienode(tr, child)->id = id;
+	}
+}
+
+/*
+ * Nodes below the first node that holds 'id' are only passed
+ * through by the removed text, that chain gets unlinked and freed.
+ */
+ASHE_PUBLIC void a_trie_remove(struct a_trie *tr, a_uint32 id, const char *text, a_uint32 len)
+{
+	a_uint32 i, k, child, *link;
+
+	if (a_arr_len(tr->tr_nodes) == 0)
+		return;
+	for (i = k = 0; k < len; k++, i = child) {
+		if ((child = find_child(tr, i, text[k])) == 0)
+			return;
+		if (trienode(tr, child)->id == id)
+			break;
+	}
+	if (k == len)
+		return; /* a newer text passes through all of them */
+	for (link = &trienode(tr, i)->child; *link != child; link = &trienode(tr, *link)->next);
+	*link = trienode(tr, child)->next;
+	while (child != 0) {
+		i = trienode(tr, child)->child;
+		trienode(tr, child)->next = tr->tr_free;
+		tr->tr_free = child;
+		child = i;
+	}
+}
+
+ASHE_PUBLIC a_ubyte a_trie_find(const struct a_trie *tr, const char *prefix, a_uint32 len, a_uint32 *id)
+{
+	a_uint32 i, k;
+	a_ubyte found;
+
+	if (a_arr_len(tr->tr_nodes) == 0)
+		return 0;
+	for (i = k = 0; k < len; k++)
+		if ((i = find_child(tr, i, prefix[k])) == 0)
+			return 0;
+	found = 0;
+	for (i = trienode(tr, i)->child; i != 0; i = trienode(tr, i)->next) {
+		if (!found || trienode(tr, i)->id > *id)
+			*id = trienode(tr, i)->id;
+		found = 1;
+	}
+	return found;
+}
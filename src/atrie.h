@@ -0,0 +1,64 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#ifndef ATRIE_H
+#define ATRIE_H
+
+#include "acommon.h"
+#include "aarray.h"
+
+
+struct a_trienode {
+	a_uint32 child; /* first child, 0 if none */
+	a_uint32 next; /* next sibling (next free node), 0 if none */
+	a_uint32 id; /* newest id of the texts with this prefix */
+	a_ubyte c;
+};
+
+ARRAY_NEW(a_arr_trienode, struct a_trienode)
+
+/*
+ * Prefix tree of texts, each node holds the newest id of the
+ * texts that pass through it. Ids are added in ascending order
+ * and removed from the lowest one up, the nodes of the removed
+ * id are then only the ones that no other text passes through,
+ * so adding, removing and finding are bounded by the text length.
+ * Zeroed 'struct a_trie' is an empty tree.
+ */
+struct a_trie {
+	a_arr_trienode tr_nodes; /* node 0 is the root */
+	a_uint32 tr_free; /* first free node, 0 if none */
+};
+
+
+void a_trie_init(struct a_trie *tr);
+void a_trie_free(struct a_trie *tr);
+
+/* Add the 'text' ('len' bytes long) under 'id', 'id' must be
+ * above all of the already added ones. */
+void a_trie_add(struct a_trie *tr, a_uint32 id, const char *text, a_uint32 len);
+
+/* Remove the 'text' added under 'id', 'id' must be the lowest one. */
+void a_trie_remove(struct a_trie *tr, a_uint32 id, const char *text, a_uint32 len);
+
+/*
+ * Find the newest id of the texts that start with 'prefix'
+ * ('len' bytes long) and are longer than it, returns 0 if
+ * there is no such text.
+ */
+a_ubyte a_trie_find(const struct a_trie *tr, const char *prefix, a_uint32 len, a_uint32 *id);
+
+#endif
@@ -0,0 +1,154 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "atrigram.h"
+#include "aalloc.h"
+
+
+/* trigram at 's' as a non zero key */
+#define tgkey(s) \
+	((((a_uint32)(a_ubyte)(s)[0] << 16) | ((a_uint32)(a_ubyte)(s)[1] << 8) | (a_ubyte)(s)[2]) + 1)
+
+
+ASHE_PUBLIC void a_trigram_init(struct a_trigram *tg)
+{
+	tg->tg_posts = NULL;
+	tg->tg_cap = tg->tg_len = 0;
+	tg->tg_minid = tg->tg_swept = tg->tg_nextid = 0;
+}
+
+ASHE_PUBLIC void a_trigram_free(struct a_trigram *tg)
+{
+	a_uint32 i;
+
+	for (i = 0; i < tg->tg_cap; i++)
+		ashe_free(tg->tg_posts[i].ids);
+	ashe_free(tg->tg_posts);
+	a_trigram_init(tg);
+}
+
+/* Slot of 'key', it is empty if 'key' is not in the table. */
+ASHE_PRIVATE struct a_tgpost *find_slot(const struct a_trigram *tg, a_uint32 key)
+{
+	a_uint32 i, mask;
+
+	mask = tg->tg_cap - 1;
+	i = (key * 2654435761u) & mask; /* Fibonacci hashing */
+	while (tg->tg_posts[i].key != 0 && tg->tg_posts[i].key != key)
+		i = (i + 1) & mask;
+	return &tg->tg_posts[i];
+}
+
+/* Double the table size, keeps the load factor below 1/2. */
+ASHE_PRIVATE void grow(struct a_trigram *tg)
+{
+	struct a_tgpost *old, *post;
+	a_uint32 i, oldcap;
+
+	old = tg->tg_posts;
+	oldcap = tg->tg_cap;
+	tg->tg_cap = (oldcap ? oldcap * 2 : 256);
+	tg->tg_posts = ashe_malloc(sizeof(*tg->tg_posts) * tg->tg_cap);
+	memset(tg->tg_posts, 0, sizeof(*tg->tg_posts) * tg->tg_cap);
+	for (i = 0; i < oldcap; i++) {
+		if (old[i].key != 0) {
+			post = find_slot(tg, old[i].key);
+			*post = old[i];
+		}
+	}
+	ashe_free(old);
+}
+
+/* Drop the expired ids from the front of 'post'. */
+ASHE_PRIVATE void trim(struct a_tgpost *post, a_uint32 minid)
+{
+	a_uint32 lo, hi, mid;
+
+	lo = 0;
+	hi = post->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (post->ids[mid] < minid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo > 0) {
+		post->len -= lo;
+		memmove(post->ids, post->ids + lo, post->len * sizeof(*post->ids));
+	}
+}
+
+ASHE_PUBLIC void a_trigram_add(struct a_trigram *tg, a_uint32 id, const char *text, a_uint32 len)
+{
+	struct a_tgpost *post;
+	a_uint32 i, key;
+
+	ashe_assert(id >= tg->tg_nextid);
+	tg->tg_nextid = id + 1;
+	for (i = 0; i < a_trigram_count(len); i++) {
+		if (a_unlikely((tg->tg_len + 1) * 2 > tg->tg_cap))
+			grow(tg);
+		key = tgkey(text + i);
+		post = find_slot(tg, key);
+		if (post->key == 0) {
+			post->key = key;
+			tg->tg_len++;
+		} else if (post->len > 0 && post->ids[post->len - 1] == id) {
+			continue; /* trigram repeats in 'text' */
+		}
+		if (post->len == post->cap) {
+			if (post->len > 0 && post->ids[0] < tg->tg_minid)
+				trim(post, tg->tg_minid);
+			if (post->len == post->cap) {
+				post->cap = (post->cap ? post->cap * 2 : 4);
+				post->ids = ashe_realloc(post->ids, post->cap * sizeof(*post->ids));
+			}
+		}
+		post->ids[post->len++] = id;
+	}
+}
+
+/*
+ * Postings that are never appended to again would keep their
+ * expired ids, once more ids expired than there are live ones
+ * all of the postings get trimmed.
+ */
+ASHE_PUBLIC void a_trigram_expire(struct a_trigram *tg, a_uint32 minid)
+{
+	a_uint32 i;
+
+	tg->tg_minid = minid;
+	if (minid - tg->tg_swept <= tg->tg_nextid - minid)
+		return;
+	for (i = 0; i < tg->tg_cap; i++)
+		if (tg->tg_posts[i].key != 0)
+			trim(&tg->tg_posts[i], minid);
+	tg->tg_swept = minid;
+}
+
+ASHE_PUBLIC const a_uint32 *a_trigram_get(const struct a_trigram *tg, const char *s, a_uint32 *n)
+{
+	struct a_tgpost *post;
+
+	*n = 0;
+	if (tg->tg_cap == 0 || (post = find_slot(tg, tgkey(s)))->key == 0)
+		return NULL;
+	*n = post->len;
+	return post->ids;
+}
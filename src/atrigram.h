@@ -0,0 +1,68 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#ifndef ATRIGRAM_H
+#define ATRIGRAM_H
+
+#include "acommon.h"
+
+
+/* ids of the texts containing the trigram 'key' */
+struct a_tgpost {
+	a_uint32 key; /* trigram bytes + 1, 0 if the slot is empty */
+	a_uint32 len;
+	a_uint32 cap;
+	a_uint32 *ids; /* ascending */
+};
+
+/*
+ * Trigram index, maps each trigram (3 consecutive bytes) to the
+ * ascending ids of the texts containing it. Ids are added in
+ * ascending order and expire from the lowest one up, so the
+ * postings are appended to and trimmed from the front only.
+ * Postings are kept in an open addressing hash table.
+ */
+struct a_trigram {
+	struct a_tgpost *tg_posts;
+	a_uint32 tg_cap; /* size of 'tg_posts' (power of 2) */
+	a_uint32 tg_len; /* used slots */
+	a_uint32 tg_minid; /* ids below this one expired */
+	a_uint32 tg_swept; /* 'tg_minid' at the last sweep */
+	a_uint32 tg_nextid; /* id above the last added one */
+};
+
+
+/* number of trigrams in a text 'len' bytes long */
+#define a_trigram_count(len) ((len) < 3 ? 0 : (len) - 2)
+
+
+void a_trigram_init(struct a_trigram *tg);
+void a_trigram_free(struct a_trigram *tg);
+
+/* Index the 'text' ('len' bytes long) under 'id', 'id' must
+ * be above all of the already added ones. */
+void a_trigram_add(struct a_trigram *tg, a_uint32 id, const char *text, a_uint32 len);
+
+/* Expire all ids below 'minid'. */
+void a_trigram_expire(struct a_trigram *tg, a_uint32 minid);
+
+/*
+ * Ids of the texts containing the trigram at 's', sets 'n' to the
+ * number of them (ids below 'tg_minid' can be among the first ones).
+ */
+const a_uint32 *a_trigram_get(const struct a_trigram *tg, const char *s, a_uint32 *n);
+
+#endif
@@ -25,9 +25,13 @@
 #include <errno.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/sysinfo.h>
 #include <time.h>
 #include <pwd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 
 static char plhbuf[BUFSIZ];
 
@@ -117,54 +121,477 @@ ASHE_PUBLIC const char *ashe_uptime(void)
 	return plhbuf;
 }
 
-ASHE_PRIVATE void expand_placeholders(a_arr_char *out, const char **ptr)
+/*
+ * Placeholders below are async, they run in helper threads,
+ * each one uses its own buffer and returns NULL on errors.
+ */
+
+/* Read up to 'size - 1' bytes of the file 'path' into 'buf'. */
+ASHE_PRIVATE a_ssize read_small_file(const char *path, char *buf, a_memmax size)
+{
+	a_ssize n;
+	a_int32 fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+	while ((n = read(fd, buf, size - 1)) < 0 && errno == EINTR);
+	close(fd);
+	if (n >= 0)
+		buf[n] = '\0';
+	return n;
+}
+
+ASHE_PUBLIC const char *ashe_vcs(void)
+{
+	static char vcsbuf[256];
+	char path[PATH_MAX], *p;
+	a_memmax len;
+
+	if (!getcwd(path, sizeof(path) - SS("/.git/HEAD")))
+		return NULL;
+	for (;;) { /* look for '.git/HEAD' up to the root */
+		len = strlen(path);
+		memcpy(path + len, "/.git/HEAD", sizeof("/.git/HEAD"));
+		if (read_small_file(path, vcsbuf, sizeof(vcsbuf)) >= 0)
+			break;
+		path[len] = '\0';
+		if (len <= 1)
+			return "";
+		p = strrchr(path, '/');
+		p[p == path] = '\0';
+	}
+	if ((p = strchr(vcsbuf, '\n')))
+		*p = '\0';
+	if (strncmp(vcsbuf, "ref: refs/heads/", SS("ref: refs/heads/")) == 0)
+		return vcsbuf + SS("ref: refs/heads/");
+	vcsbuf[7] = '\0'; /* detached, short hash */
+	return vcsbuf;
+}
+
+ASHE_PUBLIC const char *ashe_kube(void)
+{
+	static char kubebuf[8192];
+	char path[PATH_MAX], *p, *end;
+	const char *env;
+
+	if ((env = getenv("KUBECONFIG")) && *env) {
+		if (strcspn(env, ":") >= sizeof(path))
+			return NULL;
+		snprintf(path, sizeof(path), "%.*s", (int)strcspn(env, ":"), env);
+	} else if (!(env = getenv(HOME)) ||
+		   (a_memmax)snprintf(path, sizeof(path), "%s/.kube/config", env) >= sizeof(path)) {
+		return NULL;
+	}
+	if (read_small_file(path, kubebuf, sizeof(kubebuf)) < 0)
+		return "";
+	for (p = kubebuf; p; p = ((p = strchr(p, '\n')) ? p + 1 : NULL)) {
+		if (strncmp(p, "current-context:", SS("current-context:")) != 0)
+			continue;
+		for (p += SS("current-context:"); *p == ' ' || *p == '"' || *p == '\''; p++);
+		for (end = p; *end && !strchr("\"'\r\n #", *end); end++);
+		*end = '\0';
+		return p;
+	}
+	return "";
+}
+
+ASHE_PUBLIC const char *ashe_loadavg(void)
+{
+	static char loadbuf[16];
+	double load;
+
+	if (getloadavg(&load, 1) < 1)
+		return NULL;
+	snprintf(loadbuf, sizeof(loadbuf), "%.2f", load);
+	return loadbuf;
+}
+
+/* cached placeholder value */
+struct plhvalue {
+	a_arr_char value; /* null terminated */
+	time_t expires; /* 'ASHE_PLH_MINUTE' and 'ASHE_PLH_TTL' */
+	a_ubyte valid;
+};
+
+static struct plhvalue plhcache[ASHE_ELEMENTS(placeholders)];
+
+/* max length of the async placeholder value */
+#define ASYNC_VALUE_MAX 256
+
+/* number of memoized async placeholder values */
+#define ASYNC_MEMO_SIZE 16
+
+/* async placeholder computation (helper thread) */
+struct plhjob {
+	pthread_t thread;
+	a_arr_char cwd; /* directory the value is computed for */
+	char value[ASYNC_VALUE_MAX];
+	a_ubyte ok; /* function returned a value */
+	a_ubyte running; /* started and not joined yet */
+};
+
+/* async placeholder value memoized per working directory */
+struct plhmemo {
+	a_uint32 plh;
+	a_arr_char cwd;
+	a_arr_char value;
+	time_t expires; /* 'ASHE_PLH_MINUTE' and 'ASHE_PLH_TTL' */
+	a_uint32 gen; /* prompt generation, 'ASHE_PLH_NOCACHE' */
+	a_ubyte used;
+};
+
+static struct plhjob plhjobs[ASHE_ELEMENTS(placeholders)];
+static struct plhmemo plhmemo[ASYNC_MEMO_SIZE];
+static a_uint32 plhmemonext; /* memo entry to replace next */
+static a_uint32 plhgen; /* see 'ashe_refresh_placeholders()' */
+static a_uint32 plhpending; /* running helper threads */
+static a_int32 plhpipe[2] = { -1, -1 }; /* helper threads write their index */
+
+/* working directory (memo key), cached like 'ASHE_PLH_CWD' */
+static a_arr_char cwdkey;
+static a_ubyte cwdvalid;
+
+ASHE_PRIVATE const char *current_dir(void)
+{
+	const char *dir;
+
+	if (!cwdvalid) {
+		dir = ashe_adir();
+		a_arr_len(cwdkey) = 0;
+		a_arr_char_push_str(&cwdkey, dir, strlen(dir));
+		a_arr_char_push(&cwdkey, '\0');
+		cwdvalid = 1;
+	}
+	return a_arr_ptr(cwdkey);
+}
+
+ASHE_PRIVATE void *plhjob_run(void *arg)
 {
-	const char *p = *ptr;
+	struct plhjob *job;
 	const char *res;
-	a_memmax n, prev;
+	a_memmax len;
+	a_ubyte idx;
+
+	job = arg;
+	idx = job - plhjobs;
+	if ((job->ok = ((res = placeholders[idx].fn()) != NULL))) {
+		len = a_min(strlen(res), sizeof(job->value) - 1);
+		memcpy(job->value, res, len);
+		job->value[len] = '\0';
+	}
+	while (write(plhpipe[1], &idx, 1) < 0 && errno == EINTR);
+	return NULL;
+}
+
+/*
+ * Start computing the async placeholder 'n' for the directory
+ * 'cwd' in a helper thread (see 'ashe_spawn_helper()').
+ */
+ASHE_PRIVATE void plhjob_start(a_uint32 n, const char *cwd)
+{
+	struct plhjob *job;
+
+	job = &plhjobs[n];
+	a_arr_len(job->cwd) = 0;
+	a_arr_char_push_str(&job->cwd, cwd, strlen(cwd));
+	a_arr_char_push(&job->cwd, '\0');
+	if (a_likely(ashe_spawn_helper(plhjob_run, job, plhpipe, &job->thread))) {
+		job->running = 1;
+		plhpending++;
+	}
+}
+
+/* Memoized value of the async placeholder 'n' for 'cwd'. */
+ASHE_PRIVATE struct plhmemo *memo_find(a_uint32 n, const char *cwd)
+{
 	a_uint32 i;
-	a_int32 c;
 
-	if (!isdigit(*++p))
-		goto push_plh_sign;
+	for (i = 0; i < ASYNC_MEMO_SIZE; i++)
+		if (plhmemo[i].used && plhmemo[i].plh == n &&
+		    strcmp(a_arr_ptr(plhmemo[i].cwd), cwd) == 0)
+			return &plhmemo[i];
+	return NULL;
+}
 
-	n = prev = 0;
-	for (i = 0; i < ASHE_MAXNUMSTR && isdigit((c = *p)); i++, p++) {
-		n = n * 10 + (c - '0');
-		if (a_unlikely(n < prev))
-			ashe_panic("placeholder index overflowed");
-		prev = n;
+ASHE_PRIVATE a_ubyte memo_expired(struct plhmemo *memo)
+{
+	switch (placeholders[memo->plh].cache) {
+	case ASHE_PLH_NOCACHE:
+		return (memo->gen != plhgen);
+	case ASHE_PLH_MINUTE:
+	case ASHE_PLH_TTL:
+		return (time(NULL) >= memo->expires);
+	default:
+		return 0;
 	}
+}
 
-	if (a_unlikely(n >= ASHE_ELEMENTS(placeholders)))
-		goto push_plh_sign;
+/*
+ * Join the finished helper thread of the placeholder 'n' and
+ * memoize its value, returns 1 if the prompt needs to be
+ * expanded again (value changed or belongs to another directory).
+ */
+ASHE_PRIVATE a_ubyte plhjob_finish(a_uint32 n)
+{
+	const struct a_placeholder *plh;
+	struct plhjob *job;
+	struct plhmemo *memo;
+	const char *cwd;
+	time_t now;
 
-	if (a_likely((res = placeholders[n]()) != NULL)) {
-		a_arr_char_push_str(out, res, strlen(res));
-		*ptr = p;
-	} else {
-push_plh_sign:
-		a_arr_char_push(out, '%');
-		*ptr += 1;
+	if (a_unlikely(n >= ASHE_ELEMENTS(plhjobs) || !plhjobs[n].running))
+		return 0;
+	job = &plhjobs[n];
+	pthread_join(job->thread, NULL);
+	job->running = 0;
+	plhpending--;
+	cwd = a_arr_ptr(job->cwd);
+	if (!job->ok)
+		return (strcmp(cwd, current_dir()) != 0);
+	if (!(memo = memo_find(n, cwd))) {
+		memo = &plhmemo[plhmemonext];
+		plhmemonext = (plhmemonext + 1) % ASYNC_MEMO_SIZE;
+		memo->plh = n;
+		memo->used = 1;
+		a_arr_len(memo->cwd) = 0;
+		a_arr_char_push_str(&memo->cwd, cwd, strlen(cwd) + 1);
+		a_arr_len(memo->value) = 0;
+		a_arr_char_push(&memo->value, '\0');
 	}
+	plh = &placeholders[n];
+	now = time(NULL);
+	memo->gen = plhgen;
+	memo->expires = (plh->cache == ASHE_PLH_MINUTE ? (now / 60 + 1) * 60 : now + plh->ttl);
+	if (strcmp(a_arr_ptr(memo->value), job->value) == 0)
+		return (strcmp(cwd, current_dir()) != 0);
+	a_arr_len(memo->value) = 0;
+	a_arr_char_push_str(&memo->value, job->value, strlen(job->value) + 1);
+	return 1;
 }
 
-/* parses 'str' by expanding all placeholders */
-ASHE_PUBLIC void parse_placeholders(a_arr_char *out, const char *str)
+/*
+ * Value of the async placeholder 'n', memoized value (or blank)
+ * is returned right away, if it expired the helper thread is
+ * started to compute the new one.
+ */
+ASHE_PRIVATE const char *async_value(a_uint32 n)
+{
+	struct plhmemo *memo;
+	const char *cwd;
+
+	cwd = current_dir();
+	memo = memo_find(n, cwd);
+	if ((!memo || memo_expired(memo)) && !plhjobs[n].running)
+		plhjob_start(n, cwd);
+	return (memo ? a_arr_ptr(memo->value) : "");
+}
+
+ASHE_PUBLIC a_int32 ashe_async_placeholders_fd(void)
 {
-	a_int32 c;
+	return (plhpending > 0 ? plhpipe[0] : -1);
+}
+
+ASHE_PUBLIC void ashe_refresh_placeholders(void)
+{
+	plhgen++;
+}
 
-	while ((c = *str)) {
-		if (c != ASHE_PLH_SIGN) {
-			a_arr_char_push(out, c);
-			str++;
-		} else {
-			expand_placeholders(out, &str);
+/* Milliseconds of the monotonic clock. */
+ASHE_PRIVATE a_int64 clock_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (a_int64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+ASHE_PUBLIC a_ubyte ashe_collect_placeholders(a_int32 timeout)
+{
+	struct pollfd pfd;
+	a_ubyte idx[32], changed;
+	a_int64 deadline;
+	a_ssize n, i;
+
+	changed = 0;
+	deadline = clock_ms() + timeout;
+	while (plhpending > 0) {
+		pfd.fd = plhpipe[0];
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, a_max(deadline - clock_ms(), 0)) <= 0)
+			break;
+		while ((n = read(plhpipe[0], idx, sizeof(idx))) > 0)
+			for (i = 0; i < n; i++)
+				changed |= plhjob_finish(idx[i]);
+	}
+	return changed;
+}
+
+/*
+ * Get the value of the placeholder 'n', cached value is
+ * returned until it expires (see 'enum a_plhcache').
+ */
+ASHE_PRIVATE const char *placeholder_value(a_uint32 n)
+{
+	const struct a_placeholder *plh;
+	struct plhvalue *cached;
+	const char *res;
+	time_t now;
+
+	plh = &placeholders[n];
+	if (plh->async)
+		return async_value(n);
+	if (plh->cache == ASHE_PLH_NOCACHE)
+		return plh->fn();
+	cached = &plhcache[n];
+	now = 0;
+	if (plh->cache >= ASHE_PLH_MINUTE && a_unlikely((now = time(NULL)) < 0))
+		ashe_panic_libcall(time);
+	if (cached->valid && (plh->cache < ASHE_PLH_MINUTE || now < cached->expires))
+		return a_arr_ptr(cached->value);
+	if (a_unlikely((res = plh->fn()) == NULL))
+		return NULL;
+	a_arr_len(cached->value) = 0;
+	a_arr_char_push_str(&cached->value, res, strlen(res));
+	a_arr_char_push(&cached->value, '\0');
+	cached->valid = 1;
+	if (plh->cache == ASHE_PLH_MINUTE)
+		cached->expires = (now / 60 + 1) * 60;
+	else if (plh->cache == ASHE_PLH_TTL)
+		cached->expires = now + plh->ttl;
+	return a_arr_ptr(cached->value);
+}
+
+ASHE_PUBLIC void ashe_invalidate_placeholders(enum a_plhcache cache)
+{
+	a_uint32 i;
+
+	if (cache == ASHE_PLH_CWD)
+		cwdvalid = 0;
+	for (i = 0; i < ASHE_ELEMENTS(placeholders); i++)
+		if (placeholders[i].cache == cache)
+			plhcache[i].valid = 0;
+}
+
+ASHE_PUBLIC void ashe_free_placeholders(void)
+{
+	a_uint32 i;
+
+	for (i = 0; i < ASHE_ELEMENTS(placeholders); i++) {
+		a_arr_char_free(&plhcache[i].value, NULL);
+		plhcache[i].valid = 0;
+		if (plhjobs[i].running)
+			ashe_join_helper(plhjobs[i].thread);
+		plhjobs[i].running = 0;
+		a_arr_char_free(&plhjobs[i].cwd, NULL);
+	}
+	for (i = 0; i < ASYNC_MEMO_SIZE; i++) {
+		a_arr_char_free(&plhmemo[i].cwd, NULL);
+		a_arr_char_free(&plhmemo[i].value, NULL);
+		plhmemo[i].used = 0;
+	}
+	a_arr_char_free(&cwdkey, NULL);
+	cwdvalid = 0;
+	plhpending = 0;
+	if (plhpipe[0] >= 0) {
+		close(plhpipe[0]);
+		close(plhpipe[1]);
+		plhpipe[0] = plhpipe[1] = -1;
+	}
+}
+
+ASHE_PUBLIC void a_userstr_init(struct a_userstr *us)
+{
+	a_arr_char_init(&us->us_text);
+	a_arr_userseg_init(&us->us_segs);
+}
+
+ASHE_PUBLIC void a_userstr_free(struct a_userstr *us)
+{
+	a_arr_char_free(&us->us_text, NULL);
+	a_arr_userseg_free(&us->us_segs, NULL);
+}
+
+/* Append segment of 'len' bytes of 's' to 'us', literals get merged. */
+ASHE_PRIVATE void push_segment(struct a_userstr *us, const char *s, a_uint32 len, a_int32 plh)
+{
+	struct a_userseg *seg;
+
+	if (plh >= 0 || a_arr_len(us->us_segs) == 0 ||
+	    a_arr_userseg_last(&us->us_segs)->plh >= 0)
+		a_arr_userseg_push(&us->us_segs, (struct a_userseg){
+							 .off = a_arr_len(us->us_text),
+							 .len = 0,
+							 .plh = plh,
+						 });
+	seg = a_arr_userseg_last(&us->us_segs);
+	a_arr_char_push_str(&us->us_text, s, len);
+	seg->len += len;
+}
+
+/*
+ * Placeholder is the placeholder sign followed by the index
+ * into 'placeholders', anything else is literal text.
+ */
+ASHE_PUBLIC void a_userstr_compile(struct a_userstr *us, const char *str)
+{
+	const char *p;
+	a_memmax n, prev;
+	a_uint32 i;
+
+	a_arr_len(us->us_text) = 0;
+	a_arr_len(us->us_segs) = 0;
+	while (*str) {
+		if (*str != ASHE_PLH_SIGN || !isdigit(str[1])) {
+			push_segment(us, str++, 1, -1);
+			continue;
+		}
+		n = prev = 0;
+		for (p = str + 1, i = 0; i < ASHE_MAXNUMSTR && isdigit(*p); i++, p++) {
+			n = n * 10 + (*p - '0');
+			if (a_unlikely(n < prev))
+				ashe_panic("placeholder index overflowed");
+			prev = n;
 		}
+		if (a_unlikely(n >= ASHE_ELEMENTS(placeholders))) {
+			push_segment(us, str++, 1, -1);
+			continue;
+		}
+		push_segment(us, str, p - str, n);
+		str = p;
+	}
+}
+
+/*
+ * Placeholder that has no value (its function returned NULL)
+ * is expanded into its source text.
+ */
+ASHE_PUBLIC void a_userstr_expand(const struct a_userstr *us, a_arr_char *out)
+{
+	const struct a_userseg *seg;
+	const char *res;
+	a_uint32 i;
+
+	for (i = 0; i < a_arr_len(us->us_segs); i++) {
+		seg = a_arr_userseg_index(&us->us_segs, i);
+		if (seg->plh >= 0 && (res = placeholder_value(seg->plh)))
+			a_arr_char_push_str(out, res, strlen(res));
+		else
+			a_arr_char_push_str(out, a_arr_ptr(us->us_text) + seg->off, seg->len);
 	}
 	a_arr_char_push(out, '\0');
 }
 
+/* parses 'str' by expanding all placeholders */
+ASHE_PUBLIC void parse_placeholders(a_arr_char *out, const char *str)
+{
+	struct a_userstr us;
+
+	a_userstr_init(&us);
+	a_userstr_compile(&us, str);
+	a_userstr_expand(&us, out);
+	a_userstr_free(&us);
+}
+
 /* Prints and parses any arbitrary string. */
 ASHE_PUBLIC void ashe_puserstr(const char *str, a_memmax len)
 {
@@ -22,6 +22,57 @@
 
 #define ASHE_USERSTR_MAX 	((MAXCMDSIZE >> 2) ? (MAXCMDSIZE >> 2) : 1024)
 
+/* segment of the compiled user string */
+struct a_userseg {
+	a_uint32 off; /* offset in the source text */
+	a_uint32 len; /* length of the source text */
+	a_int32 plh; /* placeholder index, -1 if literal */
+};
+
+ARRAY_NEW(a_arr_userseg, struct a_userseg)
+
+/*
+ * User string compiled into literal and placeholder
+ * segments, so it can be expanded without parsing.
+ */
+struct a_userstr {
+	a_arr_char us_text; /* source text of the segments */
+	a_arr_userseg us_segs;
+};
+
+void a_userstr_init(struct a_userstr *us);
+void a_userstr_free(struct a_userstr *us);
+
+/* Compile 'str' into segments. */
+void a_userstr_compile(struct a_userstr *us, const char *str);
+
+/* Expand compiled 'us' into 'out' (null terminated). */
+void a_userstr_expand(const struct a_userstr *us, a_arr_char *out);
+
+/* Drop cached values of placeholders with 'cache' policy. */
+void ashe_invalidate_placeholders(enum a_plhcache cache);
+
+/* Free cached placeholder values (joins helper threads). */
+void ashe_free_placeholders(void);
+
+/*
+ * Start a new prompt generation, async 'ASHE_PLH_NOCACHE'
+ * placeholders get recomputed on the next expansion.
+ */
+void ashe_refresh_placeholders(void);
+
+/*
+ * Collect values of async placeholders that finished, waiting
+ * at most 'timeout' milliseconds for the running ones.
+ * Returns 1 if any value changed (user string should be
+ * expanded again).
+ */
+a_ubyte ashe_collect_placeholders(a_int32 timeout);
+
+/* File descriptor that becomes readable once an async
+ * placeholder finishes, -1 if none is running. */
+a_int32 ashe_async_placeholders_fd(void);
+
 void ashe_puserstr(const char *str, a_memmax len);
 void ashe_pwelcome(void);
 void parse_placeholders(a_arr_char *out, const char *str);
@@ -0,0 +1,194 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#include "autf8.h"
+
+
+/* inclusive range of code points */
+struct urange {
+	a_uint32 lo, hi;
+};
+
+/* combining marks, format and other zero width characters */
+static const struct urange zerowidth[] = {
+	{0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF},
+	{0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A},
+	{0x064B, 0x065F}, {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4},
+	{0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0711, 0x0711}, {0x0730, 0x074A},
+	{0x07A6, 0x07B0}, {0x07EB, 0x07F3}, {0x0816, 0x0819}, {0x081B, 0x0823},
+	{0x0825, 0x0827}, {0x0829, 0x082D}, {0x0859, 0x085B}, {0x0898, 0x089F},
+	{0x08CA, 0x08E1}, {0x08E3, 0x0902}, {0x093A, 0x093A}, {0x093C, 0x093C},
+	{0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963},
+	{0x0981, 0x0981}, {0x09BC, 0x09BC}, {0x09C1, 0x09C4}, {0x09CD, 0x09CD},
+	{0x09E2, 0x09E3}, {0x0A01, 0x0A02}, {0x0A3C, 0x0A3C}, {0x0A41, 0x0A42},
+	{0x0A47, 0x0A48}, {0x0A4B, 0x0A4D}, {0x0A70, 0x0A71}, {0x0A81, 0x0A82},
+	{0x0ABC, 0x0ABC}, {0x0AC1, 0x0AC5}, {0x0AC7, 0x0AC8}, {0x0ACD, 0x0ACD},
+	{0x0B01, 0x0B01}, {0x0B3C, 0x0B3C}, {0x0B3F, 0x0B3F}, {0x0B41, 0x0B44},
+	{0x0B4D, 0x0B4D}, {0x0BC0, 0x0BC0}, {0x0BCD, 0x0BCD}, {0x0C3E, 0x0C40},
+	{0x0C46, 0x0C48}, {0x0C4A, 0x0C4D}, {0x0CBC, 0x0CBC}, {0x0CCC, 0x0CCD},
+	{0x0D41, 0x0D44}, {0x0D4D, 0x0D4D}, {0x0DCA, 0x0DCA}, {0x0DD2, 0x0DD4},
+	{0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x0EB1, 0x0EB1},
+	{0x0EB4, 0x0EBC}, {0x0EC8, 0x0ECD}, {0x0F18, 0x0F19}, {0x0F35, 0x0F35},
+	{0x0F37, 0x0F37}, {0x0F39, 0x0F39}, {0x0F71, 0x0F7E}, {0x0F80, 0x0F84},
+	{0x0F86, 0x0F87}, {0x0F8D, 0x0FBC}, {0x0FC6, 0x0FC6}, {0x102D, 0x1030},
+	{0x1032, 0x1037}, {0x1039, 0x103A}, {0x1058, 0x1059}, {0x1160, 0x11FF},
+	{0x135D, 0x135F}, {0x1712, 0x1714}, {0x1732, 0x1733}, {0x1752, 0x1753},
+	{0x1772, 0x1773}, {0x17B4, 0x17B5}, {0x17B7, 0x17BD}, {0x17C6, 0x17C6},
+	{0x17C9, 0x17D3}, {0x17DD, 0x17DD}, {0x180B, 0x180F}, {0x18A9, 0x18A9},
+	{0x1920, 0x1922}, {0x1927, 0x1928}, {0x1932, 0x1932}, {0x1939, 0x193B},
+	{0x1A17, 0x1A18}, {0x1AB0, 0x1AFF}, {0x1B00, 0x1B03}, {0x1B34, 0x1B34},
+	{0x1B36, 0x1B3A}, {0x1B3C, 0x1B3C}, {0x1B42, 0x1B42}, {0x1B6B, 0x1B73},
+	{0x1DC0, 0x1DFF}, {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064},
+	{0x20D0, 0x20FF}, {0x2CEF, 0x2CF1}, {0x2DE0, 0x2DFF}, {0x302A, 0x302D},
+	{0x3099, 0x309A}, {0xA66F, 0xA672}, {0xA674, 0xA67D}, {0xA69E, 0xA69F},
+	{0xA6F0, 0xA6F1}, {0xA802, 0xA802}, {0xA806, 0xA806}, {0xA80B, 0xA80B},
+	{0xA825, 0xA826}, {0xA8C4, 0xA8C5}, {0xA8E0, 0xA8F1}, {0xFB1E, 0xFB1E},
+	{0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0xFFF9, 0xFFFB},
+	{0x1D167, 0x1D169}, {0x1D173, 0x1D182}, {0x1D185, 0x1D18B},
+	{0x1D1AA, 0x1D1AD}, {0xE0001, 0xE0001}, {0xE0020, 0xE007F},
+	{0xE0100, 0xE01EF},
+};
+
+/* East Asian wide and fullwidth characters, emoji */
+static const struct urange widewidth[] = {
+	{0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC},
+	{0x23F0, 0x23F0}, {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615},
+	{0x2648, 0x2653}, {0x267F, 0x267F}, {0x2693, 0x2693}, {0x26A1, 0x26A1},
+	{0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5}, {0x26CE, 0x26CE},
+	{0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+	{0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B},
+	{0x2728, 0x2728}, {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755},
+	{0x2757, 0x2757}, {0x2795, 0x2797}, {0x27B0, 0x27B0}, {0x27BF, 0x27BF},
+	{0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55}, {0x2E80, 0x303E},
+	{0x3041, 0x4DBF}, {0x4E00, 0xA4CF}, {0xA960, 0xA97F}, {0xAC00, 0xD7A3},
+	{0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F}, {0xFF00, 0xFF60},
+	{0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4}, {0x17000, 0x18CFF},
+	{0x1B000, 0x1B2FF}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF},
+	{0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251},
+	{0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF}, {0x1F7E0, 0x1F7EB},
+	{0x1F90C, 0x1F9FF}, {0x1FA70, 0x1FAFF}, {0x20000, 0x2FFFD},
+	{0x30000, 0x3FFFD},
+};
+
+#define BMPSIZE 0x10000
+
+/*
+ * Widths of the Basic Multilingual Plane, 2 bits per code
+ * point (16 KiB), built on the first lookup.
+ * Each entry holds 'width ^ 1' so that the zeroed table
+ * already describes the common width of 1.
+ */
+static a_ubyte bmpwidth[BMPSIZE / 4];
+static a_ubyte bmpready = 0;
+
+#define bmp_get(cp)	   ((bmpwidth[(cp) >> 2] >> (((cp) & 3) << 1)) & 3)
+#define bmp_set(cp, w) (bmpwidth[(cp) >> 2] |= (((w) ^ 1) << (((cp) & 3) << 1)))
+
+
+ASHE_PRIVATE void bmp_fill(const struct urange *r, a_uint32 n, a_uint32 w)
+{
+	a_uint32 i, cp;
+
+	for (i = 0; i < n && r[i].lo < BMPSIZE; i++)
+		for (cp = r[i].lo; cp <= r[i].hi && cp < BMPSIZE; cp++)
+			bmp_set(cp, w);
+}
+
+ASHE_PRIVATE void bmp_build(void)
+{
+	a_uint32 cp;
+
+	for (cp = 0; cp < 0x20; cp++)
+		bmp_set(cp, 0);
+	for (cp = 0x7F; cp < 0xA0; cp++)
+		bmp_set(cp, 0);
+	bmp_fill(zerowidth, ASHE_ELEMENTS(zerowidth), 0);
+	bmp_fill(widewidth, ASHE_ELEMENTS(widewidth), 2);
+	bmpready = 1;
+}
+
+ASHE_PRIVATE a_ubyte inranges(const struct urange *r, a_uint32 n, a_uint32 cp)
+{
+	a_uint32 l, h, m;
+
+	l = 0;
+	h = n;
+	while (l < h) {
+		m = l + (h - l) / 2;
+		if (cp < r[m].lo) h = m;
+		else if (cp > r[m].hi) l = m + 1;
+		else return 1;
+	}
+	return 0;
+}
+
+ASHE_PUBLIC a_uint32 a_utf8_width(a_uint32 cp)
+{
+	if (cp < 0x7F) return (cp >= 0x20);
+	if (cp < BMPSIZE) {
+		if (a_unlikely(!bmpready)) bmp_build();
+		return bmp_get(cp) ^ 1;
+	}
+	if (inranges(widewidth, ASHE_ELEMENTS(widewidth), cp)) return 2;
+	if (inranges(zerowidth, ASHE_ELEMENTS(zerowidth), cp)) return 0;
+	return 1;
+}
+
+ASHE_PUBLIC a_uint32 a_utf8_decode(const char *s, a_uint32 len, a_uint32 *cp)
+{
+	const a_ubyte *p = (const a_ubyte *)s;
+	a_uint32 n, i, c;
+
+	if (p[0] < 0x80) {
+		*cp = p[0];
+		return 1;
+	}
+	if (p[0] < 0xC2 || p[0] > 0xF4) goto invalid;
+	n = a_utf8_seqlen(p[0]);
+	if (n > len) goto invalid;
+	c = p[0] & (0x7F >> n);
+	for (i = 1; i < n; i++) {
+		if (!a_utf8_iscont(p[i])) goto invalid;
+		c = (c << 6) | (p[i] & 0x3F);
+	}
+	if ((n == 3 && c < 0x800) || (n == 4 && (c < 0x10000 || c > 0x10FFFF)) ||
+	    (c >= 0xD800 && c <= 0xDFFF))
+		goto invalid;
+	*cp = c;
+	return n;
+invalid:
+	*cp = A_UTF8_REPLACEMENT;
+	return 1;
+}
+
+ASHE_PUBLIC a_uint32 a_utf8_esclen(const char *s, a_uint32 len)
+{
+	a_uint32 i;
+
+	if (len < 2) return len;
+	if (s[1] == '[') { /* CSI, ends with the final byte */
+		for (i = 2; i < len && !(s[i] >= 0x40 && s[i] <= 0x7E); i++)
+			;
+		return a_min(i + 1, len);
+	} else if (s[1] == ']') { /* OSC, ends with BEL or ST */
+		for (i = 2; i < len; i++) {
+			if (s[i] == '\a') return i + 1;
+			if (s[i] == '\033' && i + 1 < len && s[i + 1] == '\\') return i + 2;
+		}
+		return len;
+	}
+	return 2;
+}
@@ -0,0 +1,56 @@
+/* ----------------------------------------------------------------------------------------------
+ * Copyright (C) 2023-2024 Jure Bagić
+ *
+ * This file is part of ashe.
+ * ashe is free software: you can redistribute it and/or modify it under the terms of the GNU
+ * General Public License as published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * ashe is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ * without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with ashe.
+ * If not, see <https://www.gnu.org/licenses/>.
+ * ----------------------------------------------------------------------------------------------*/
+
+#ifndef AUTF8_H
+#define AUTF8_H
+
+#include "acommon.h"
+
+
+/* replacement character (invalid sequences decode to it) */
+#define A_UTF8_REPLACEMENT 0xFFFD
+
+/* 'c' is a UTF-8 continuation byte */
+#define a_utf8_iscont(c) (((a_ubyte)(c) & 0xC0) == 0x80)
+
+/* length of the sequence that starts with the lead byte 'c' */
+#define a_utf8_seqlen(c) \
+	((a_ubyte)(c) < 0xC0 ? 1 : (a_ubyte)(c) < 0xE0 ? 2 : (a_ubyte)(c) < 0xF0 ? 3 : 4)
+
+
+/*
+ * Decode the character at 's' ('len' bytes available), code
+ * point is stored in 'cp' and the length in bytes is returned.
+ * Invalid, overlong or truncated sequence decodes into
+ * 'A_UTF8_REPLACEMENT' of length 1.
+ */
+a_uint32 a_utf8_decode(const char *s, a_uint32 len, a_uint32 *cp);
+
+/*
+ * Display width (terminal columns) of the code point 'cp',
+ * 0 for combining and control characters, 2 for East Asian
+ * wide and fullwidth characters, 1 for the rest.
+ */
+a_uint32 a_utf8_width(a_uint32 cp);
+
+/*
+ * Length of the escape sequence at 's' ('len' bytes available),
+ * 's' must start with ESC. CSI sequences end with the final
+ * byte, others are two bytes long.
+ */
+a_uint32 a_utf8_esclen(const char *s, a_uint32 len);
+
+#endif
@@ -15,6 +15,11 @@
  * ----------------------------------------------------------------------------------------------*/
 
 #include "autils.h"
+#include "ashell.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
 
 /*
  * Allowed specifiers:
@@ -290,13 +295,14 @@ ASHE_PUBLIC a_ubyte ashe_indq(const char *restrict str, a_memmax len)
 	return dq;
 }
 
+/* Character at 'curpos' is escaped if an odd number of '\\' precede it. */
 ASHE_PUBLIC a_ubyte ashe_isescaped(const char *restrict str, a_memmax curpos)
 {
 	const char *at;
 
 	ashe_assert(str != NULL);
-	at = str + curpos;
-	return (curpos > 0 && ((curpos > 1 && at[-1] == '\\' && at[-2] != '\\') || at[-1] == '\\'));
+	for (at = str + curpos; at > str && at[-1] == '\\'; at--);
+	return ((str + curpos - at) & 1);
 }
 
 /* Unescape tabs, newlines, etc.. for more readable output in debug functions. */
@@ -373,3 +379,45 @@ ASHE_PUBLIC const char *ashe_strnchr(const char buff[], a_memmax size, a_int32 d
 	for (i = 0; i < size && buff[i] != delim; i++);
 	return (i >= size ? NULL : buff + i);
 }
+
+
+/*
+ * Start 'fn(arg)' in a helper thread, 'tid' is set to it. Returns
+ * 1 if it started. Helper threads follow these rules:
+ * 	- all signals are blocked in them, the main thread handles them
+ * 	- they must not panic, so they allocate with libc directly
+ * 	  and never call 'ashe_malloc()' and others that can panic
+ * 	- they report to the main thread by writing into the pipe
+ * 	  'pipefd', created here on the first call (read end is
+ * 	  non-blocking, both ends are close-on-exec)
+ * 	- forks do not have them, so they are only joined in the
+ * 	  shell itself (see 'ashe_join_helper()')
+ */
+ASHE_PUBLIC a_ubyte ashe_spawn_helper(void *(*fn)(void *), void *arg, a_int32 pipefd[2],
+				      pthread_t *tid)
+{
+	sigset_t all, old;
+	a_int32 err;
+
+	if (a_unlikely(pipefd[0] < 0)) {
+		if (a_unlikely(pipe(pipefd) < 0))
+			return 0;
+		fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+		fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+		fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+	}
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	err = pthread_create(tid, NULL, fn, arg);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return (err == 0);
+}
+
+/* Join the helper thread 'tid', returns 0 in forks (nothing to join). */
+ASHE_PUBLIC a_ubyte ashe_join_helper(pthread_t tid)
+{
+	if (ashe.sh_flags.isfork)
+		return 0;
+	pthread_join(tid, NULL);
+	return 1;
+}
@@ -17,6 +17,7 @@
 #ifndef AUTILS_H
 #define AUTILS_H
 
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 
@@ -72,4 +73,8 @@ void ashe_expandvars(a_arr_char *buffer);
 /* 'strchr' for non-null terminated strings */
 const char *ashe_strnchr(const char buff[], a_memmax size, a_int32 delim);
 
+/* helper threads (see [autils.c: ashe_spawn_helper()]) */
+a_ubyte ashe_spawn_helper(void *(*fn)(void *), void *arg, a_int32 pipefd[2], pthread_t *tid);
+a_ubyte ashe_join_helper(pthread_t tid);
+
 #endif